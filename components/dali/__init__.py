@@ -1,26 +1,47 @@
 from typing import OrderedDict
-from esphome import pins
-from esphome.const import CONF_ID, CONF_RX_PIN, CONF_TX_PIN, CONF_DISCOVERY
+from esphome import automation, pins
+from esphome.const import CONF_ID, CONF_RX_PIN, CONF_TX_PIN, CONF_DISCOVERY, CONF_ADDRESS, CONF_TRIGGER_ID
 from esphome.core import CORE
 
 import esphome.codegen as cg
 import esphome.config_validation as cv
 
 AUTO_LOAD = ["light", "output"]
+MULTI_CONF = True
 
 CONF_DALI_BUS = 'dali_bus'
 CONF_INITIALIZE_ADDRESSES = 'initialize_addresses'
+CONF_MONITOR = 'monitor'
+CONF_HEALTH_CHECK_INTERVAL = 'health_check_interval'
+CONF_ON_PROGRESS = 'on_progress'
+CONF_NEW_ADDRESS = 'new_address'
+CONF_MAX_DISCOVERED_LIGHTS = 'max_discovered_lights'
 
 dali_ns = cg.esphome_ns.namespace('dali')
 dali_lib_ns = cg.global_ns
 DaliBusComponent = dali_ns.class_('DaliBusComponent', cg.Component)
+DaliLightSlot = dali_ns.struct('DaliLightSlot')
+
+DaliIdentifyAction = dali_ns.class_('DaliIdentifyAction', automation.Action)
+DaliSavePersistentVariablesAction = dali_ns.class_('DaliSavePersistentVariablesAction', automation.Action)
+DaliChangeShortAddressAction = dali_ns.class_('DaliChangeShortAddressAction', automation.Action)
+DaliRunDiscoveryAction = dali_ns.class_('DaliRunDiscoveryAction', automation.Action)
+DaliProgressTrigger = dali_ns.class_('DaliProgressTrigger', automation.Trigger.template(cg.std_string, cg.uint32, cg.uint32))
 
 CONFIG_SCHEMA = cv.Schema({
     cv.GenerateID(): cv.declare_id(DaliBusComponent),
-    cv.Required(CONF_RX_PIN): pins.gpio_input_pin_schema,
+    cv.Required(CONF_RX_PIN): pins.internal_gpio_input_pin_schema,
     cv.Required(CONF_TX_PIN): pins.gpio_output_pin_schema,
     cv.Optional(CONF_DISCOVERY): cv.All(cv.requires_component("light"), cv.boolean),
     cv.Optional(CONF_INITIALIZE_ADDRESSES): cv.boolean,
+    # Slots reserved for lights created by discovery, each one is a statically allocated
+    # DaliLight, LightState and effects (over 1 KB), so only reserve what the bus needs
+    cv.Optional(CONF_MAX_DISCOVERED_LIGHTS, default=8): cv.int_range(1, 64),
+    cv.Optional(CONF_MONITOR): cv.boolean,
+    cv.Optional(CONF_HEALTH_CHECK_INTERVAL): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_ON_PROGRESS): automation.validate_automation({
+        cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(DaliProgressTrigger),
+    }),
 }).extend(cv.COMPONENT_SCHEMA)
 
 async def to_code(config: OrderedDict):
@@ -45,5 +66,65 @@ async def to_code(config: OrderedDict):
         # making the core think there is at least one light defined.
         CORE.register_platform_component("light", bus)
 
+        # Static storage for discovered lights, sized here so discovery never allocates
+        pool = f"{config[CONF_ID]}_light_pool"
+        size = config[CONF_MAX_DISCOVERED_LIGHTS]
+        cg.add_global(cg.RawStatement(f"static {DaliLightSlot} {pool}[{size}];"))
+        cg.add(var.set_light_pool(cg.RawExpression(pool), size))
+
     if config.get(CONF_INITIALIZE_ADDRESSES, False):
         cg.add(var.do_initialize_addresses())
+
+    if config.get(CONF_MONITOR, False):
+        cg.add(var.set_monitor(True))
+
+    if CONF_HEALTH_CHECK_INTERVAL in config:
+        cg.add(var.set_health_check_interval(config[CONF_HEALTH_CHECK_INTERVAL]))
+
+    for conf in config.get(CONF_ON_PROGRESS, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger, [(cg.std_string, "operation"), (cg.uint32, "done"), (cg.uint32, "total")], conf
+        )
+
+
+# Device management actions, for API services and buttons
+
+ADDRESS_ACTION_SCHEMA = cv.Schema({
+    cv.GenerateID(): cv.use_id(DaliBusComponent),
+    cv.Required(CONF_ADDRESS): cv.templatable(cv.int_range(0, 63)),
+})
+
+CHANGE_SHORT_ADDRESS_ACTION_SCHEMA = ADDRESS_ACTION_SCHEMA.extend({
+    # 0xFF clears the short address
+    cv.Required(CONF_NEW_ADDRESS): cv.templatable(cv.Any(cv.int_range(0, 63), cv.one_of(0xFF))),
+})
+
+RUN_DISCOVERY_ACTION_SCHEMA = cv.Schema({
+    cv.GenerateID(): cv.use_id(DaliBusComponent),
+})
+
+async def address_action_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    address = await cg.templatable(config[CONF_ADDRESS], args, cg.uint8)
+    cg.add(var.set_address(address))
+    return var
+
+automation.register_action('dali.identify', DaliIdentifyAction, ADDRESS_ACTION_SCHEMA)(address_action_to_code)
+automation.register_action(
+    'dali.save_persistent_variables', DaliSavePersistentVariablesAction, ADDRESS_ACTION_SCHEMA
+)(address_action_to_code)
+
+@automation.register_action('dali.change_short_address', DaliChangeShortAddressAction, CHANGE_SHORT_ADDRESS_ACTION_SCHEMA)
+async def change_short_address_to_code(config, action_id, template_arg, args):
+    var = await address_action_to_code(config, action_id, template_arg, args)
+    new_address = await cg.templatable(config[CONF_NEW_ADDRESS], args, cg.uint8)
+    cg.add(var.set_new_address(new_address))
+    return var
+
+@automation.register_action('dali.run_discovery', DaliRunDiscoveryAction, RUN_DISCOVERY_ACTION_SCHEMA)
+async def run_discovery_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
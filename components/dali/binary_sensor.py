@@ -0,0 +1,97 @@
+from esphome.components import binary_sensor
+from esphome.const import (
+    CONF_ADDRESS, CONF_TYPE, DEVICE_CLASS_CONNECTIVITY, DEVICE_CLASS_OCCUPANCY, DEVICE_CLASS_PROBLEM,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+import esphome.codegen as cg
+import esphome.config_validation as cv
+
+from . import dali_ns, CONF_DALI_BUS, DaliBusComponent
+
+DEPENDENCIES = ['dali']
+
+CONF_INSTANCE = 'instance'
+
+DaliHealthSensor = dali_ns.class_('DaliHealthSensor', binary_sensor.BinarySensor, cg.Component)
+DaliBusStatusSensor = dali_ns.class_('DaliBusStatusSensor', binary_sensor.BinarySensor, cg.Component)
+DaliInputBinarySensor = dali_ns.class_('DaliInputBinarySensor', binary_sensor.BinarySensor, cg.Component)
+
+DaliHealthType = dali_ns.enum("DaliHealthType", is_class=True)
+DALI_HEALTH_TYPES = {
+    # QUERY_STATUS, checked every sweep
+    "gear_failure": DaliHealthType.GEAR_FAILURE,
+    "lamp_failure": DaliHealthType.LAMP_FAILURE,
+    # DT6 QUERY_FAILURE_STATUS, only queried when the status reports a failure
+    "short_circuit": DaliHealthType.SHORT_CIRCUIT,
+    "open_circuit": DaliHealthType.OPEN_CIRCUIT,
+    "load_decrease": DaliHealthType.LOAD_DECREASE,
+    "load_increase": DaliHealthType.LOAD_INCREASE,
+    "current_protector_active": DaliHealthType.CURRENT_PROTECTOR_ACTIVE,
+    "thermal_shutdown": DaliHealthType.THERMAL_SHUTDOWN,
+    "thermal_overload": DaliHealthType.THERMAL_OVERLOAD,
+    "reference_measurement_failed": DaliHealthType.REFERENCE_MEASUREMENT_FAILED,
+}
+
+# Event frames of DALI-2 input devices
+DaliInputType = dali_ns.enum("DaliInputType", is_class=True)
+DALI_INPUT_TYPES = {
+    "button": DaliInputType.BUTTON,
+    "occupancy": DaliInputType.OCCUPANCY,
+}
+
+HEALTH_SCHEMA = binary_sensor.binary_sensor_schema(
+    DaliHealthSensor,
+    device_class=DEVICE_CLASS_PROBLEM,
+).extend({
+    cv.GenerateID(CONF_DALI_BUS): cv.use_id(DaliBusComponent),
+    cv.Required(CONF_ADDRESS): cv.int_range(0, 63),
+}).extend(cv.COMPONENT_SCHEMA)
+
+# On while the bus has power
+BUS_STATUS_SCHEMA = binary_sensor.binary_sensor_schema(
+    DaliBusStatusSensor,
+    device_class=DEVICE_CLASS_CONNECTIVITY,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend({
+    cv.GenerateID(CONF_DALI_BUS): cv.use_id(DaliBusComponent),
+}).extend(cv.COMPONENT_SCHEMA)
+
+def input_schema(**kwargs):
+    return binary_sensor.binary_sensor_schema(
+        DaliInputBinarySensor,
+        **kwargs,
+    ).extend({
+        cv.GenerateID(CONF_DALI_BUS): cv.use_id(DaliBusComponent),
+        cv.Required(CONF_ADDRESS): cv.int_range(0, 63), # Input device short address
+        cv.Optional(CONF_INSTANCE, default=0): cv.int_range(0, 31),
+    }).extend(cv.COMPONENT_SCHEMA)
+
+CONFIG_SCHEMA = cv.typed_schema(
+    {
+        **{name: HEALTH_SCHEMA for name in DALI_HEALTH_TYPES},
+        "button": input_schema(),
+        "occupancy": input_schema(device_class=DEVICE_CLASS_OCCUPANCY),
+        "bus_status": BUS_STATUS_SCHEMA,
+    },
+    key=CONF_TYPE,
+    lower=True,
+)
+
+async def to_code(config):
+    parent = await cg.get_variable(config[CONF_DALI_BUS])
+
+    var = await binary_sensor.new_binary_sensor(config, parent)
+    await cg.register_component(var, config)
+
+    if config[CONF_TYPE] == "bus_status":
+        return
+
+    cg.add(var.set_address(config[CONF_ADDRESS]))
+
+    if config[CONF_TYPE] in DALI_INPUT_TYPES:
+        cg.add(var.set_instance(config[CONF_INSTANCE]))
+        cg.add(var.set_type(DALI_INPUT_TYPES[config[CONF_TYPE]]))
+        cg.add(parent.set_input_events(True))
+    else:
+        cg.add(var.set_type(DALI_HEALTH_TYPES[config[CONF_TYPE]]))
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cmath>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
@@ -8,6 +9,9 @@
 #include "esp_rom_sys.h"
 
 #include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #if !defined(DALI_LOGD)
 #if defined(ESPHOME_LOG_LEVEL)
@@ -41,6 +45,19 @@ typedef uint8_t short_addr_t;
 #define DALI_COMMAND    (0x01)
 #define DALI_DIRECT_ARC (0x00)
 
+// 24 bit frames for control devices (IEC 62386-103): address byte, instance byte, opcode
+#define DEVICE_ADDR_BROADCAST (0xFF)
+#define DEVICE_INSTANCE_DEVICE (0xFE) // Command addressed to the device itself
+#define DEVICE_INSTANCE_BROADCAST (0xFF) // All instances of the device
+#define DEVICE_SPECIAL_ADDR (0xC1) // Address byte of special commands (DTR0/1/2 ...)
+
+// IEC 62386-101 half-bit limits in ns: what a transmitter may send, and what a receiver must accept
+#define DALI_HALF_BIT_NS        (416667)
+#define DALI_TX_HALF_BIT_MIN_NS (400000)
+#define DALI_TX_HALF_BIT_MAX_NS (433333)
+#define DALI_RX_HALF_BIT_MIN_NS (333333)
+#define DALI_RX_HALF_BIT_MAX_NS (500000)
+
 #define ASSIGN_ALL           (0x00)
 #define ASSIGN_UNINITIALIZED (0xFF)
 
@@ -109,7 +126,7 @@ enum class DaliCommand : uint8_t {
     QUERY_RANDOM_ADDRESS_H = 0xC2, // Returns the upper byte of a randomly generated address
     QUERY_RANDOM_ADDRESS_M = 0xC3, // Returns the high byte of a randomly generated address
     QUERY_RANDOM_ADDRESS_L = 0xC4, // Returns the low byte of a randomly generated address
-    //READ_MEMORY_LOCATION = 0xC5 // Returns the content of the memory location stored in DTR0 that is located within the memory bank listed in DTR1
+    READ_MEMORY_LOCATION = 0xC5, // Returns the content of the memory location stored in DTR0 that is located within the memory bank listed in DTR1
 };
 
 enum class DaliSpecialCommand : uint8_t {
@@ -218,12 +235,128 @@ enum class DaliLedDimmingCurve : uint8_t {
     LINEAR = 1
 };
 
+// Control device commands (IEC 62386-103)
+// https://github.com/sde1000/python-dali/blob/master/dali/device/general.py
+enum class DaliDeviceCommand : uint8_t {
+    // Device commands, instance byte DEVICE_INSTANCE_DEVICE
+    IDENTIFY_DEVICE = 0x00,
+    RESET_POWER_CYCLE_SEEN = 0x01,
+    RESET = 0x10, // Send twice
+    RESET_MEMORY_BANK = 0x11, // Send twice
+    SET_SHORT_ADDRESS = 0x14, // Send twice, DTR0
+    ENABLE_WRITE_MEMORY = 0x15, // Send twice
+    ENABLE_APPLICATION_CONTROLLER = 0x16, // Send twice
+    DISABLE_APPLICATION_CONTROLLER = 0x17, // Send twice
+    SET_OPERATING_MODE = 0x18, // Send twice, DTR0
+    START_QUIESCENT_MODE = 0x1D, // Send twice
+    STOP_QUIESCENT_MODE = 0x1E, // Send twice
+    ENABLE_POWER_CYCLE_NOTIFICATION = 0x1F, // Send twice
+    DISABLE_POWER_CYCLE_NOTIFICATION = 0x20, // Send twice
+    SAVE_PERSISTENT_VARIABLES = 0x21, // Send twice
+    QUERY_DEVICE_STATUS = 0x30,
+    QUERY_APPLICATION_CONTROLLER_ERROR = 0x31,
+    QUERY_INPUT_DEVICE_ERROR = 0x32,
+    QUERY_MISSING_SHORT_ADDRESS = 0x33,
+    QUERY_VERSION_NUMBER = 0x34,
+    QUERY_NUMBER_OF_INSTANCES = 0x35,
+    QUERY_CONTENT_DTR0 = 0x36,
+    QUERY_CONTENT_DTR1 = 0x37,
+    QUERY_CONTENT_DTR2 = 0x38,
+
+    // Instance commands, instance byte selects the instance
+    SET_EVENT_PRIORITY = 0x61, // Send twice, DTR0
+    ENABLE_INSTANCE = 0x62, // Send twice
+    DISABLE_INSTANCE = 0x63, // Send twice
+    SET_PRIMARY_INSTANCE_GROUP = 0x64, // Send twice, DTR0
+    SET_INSTANCE_GROUP_1 = 0x65, // Send twice, DTR0
+    SET_INSTANCE_GROUP_2 = 0x66, // Send twice, DTR0
+    SET_EVENT_SCHEME = 0x67, // Send twice, DTR0
+    SET_EVENT_FILTER = 0x68, // Send twice, DTR2:DTR1:DTR0
+    QUERY_INSTANCE_TYPE = 0x80,
+    QUERY_RESOLUTION = 0x81,
+    QUERY_INSTANCE_ERROR = 0x82,
+    QUERY_INSTANCE_STATUS = 0x83,
+    QUERY_EVENT_PRIORITY = 0x84,
+    QUERY_INSTANCE_ENABLED = 0x86,
+    QUERY_PRIMARY_INSTANCE_GROUP = 0x88,
+    QUERY_INSTANCE_GROUP_1 = 0x89,
+    QUERY_INSTANCE_GROUP_2 = 0x8A,
+    QUERY_EVENT_SCHEME = 0x8B,
+    QUERY_INPUT_VALUE = 0x8C,
+    QUERY_INPUT_VALUE_LATCH = 0x8D,
+    QUERY_EVENT_FILTER_0_7 = 0x90,
+    QUERY_EVENT_FILTER_8_15 = 0x91,
+    QUERY_EVENT_FILTER_16_23 = 0x92,
+};
+
+// Special control device commands, address byte DEVICE_SPECIAL_ADDR, data in the opcode byte
+enum class DaliDeviceSpecialCommand : uint8_t {
+    DTR0 = 0x30,
+    DTR1 = 0x31,
+    DTR2 = 0x32,
+};
+
+// Event addressing schemes for SET_EVENT_SCHEME
+enum class DaliEventScheme : uint8_t {
+    INSTANCE = 0,
+    DEVICE = 1,
+    DEVICE_INSTANCE = 2,
+    DEVICE_GROUP = 3,
+    INSTANCE_GROUP = 4,
+};
+
+/// @brief Receives the backward frame of an asynchronous query (0 if there was no reply)
+typedef std::function<void(uint8_t reply)> DaliQueryCallback;
+
 /// @brief Abstract class for interfacing with a physical DALI bus
 class DaliPort {
 public:
     virtual void sendForwardFrame(uint8_t address, uint8_t data) = 0;
     virtual uint8_t receiveBackwardFrame(unsigned long timeout_ms = 100);
 
+    /// @brief Send a forward frame and wait for the backward frame answering it
+    /// @remark Ports that run the bus from another task override this so the frame
+    /// and its reply are handled as one transaction.
+    /// @return Response byte, or 0 if no reply was received
+    virtual uint8_t sendQueryFrame(uint8_t address, uint8_t data, unsigned long timeout_ms = 100) {
+        sendForwardFrame(address, data);
+        return receiveBackwardFrame(timeout_ms);
+    }
+
+    /// @brief Send a forward frame twice, for commands that only take effect when repeated
+    /// @remark Both frames must arrive within 100 ms. Ports that run the bus from another task
+    /// override this and send the repeat right after the first frame, without blocking the caller.
+    virtual void sendForwardFrameTwice(uint8_t address, uint8_t data) {
+        sendForwardFrame(address, data);
+        sendForwardFrame(address, data);
+    }
+
+    /// @brief Send a 24 bit forward frame, used by control devices (IEC 62386-103)
+    /// @remark 16 bit frames keep their own path, ports without 24 bit support drop the frame.
+    virtual void sendForwardFrame24(uint8_t /*address*/, uint8_t /*instance*/, uint8_t /*opcode*/) {
+        DALI_LOGE("24 bit frames are not supported by this port");
+    }
+
+    /// @brief Send a 24 bit forward frame twice
+    virtual void sendForwardFrame24Twice(uint8_t address, uint8_t instance, uint8_t opcode) {
+        sendForwardFrame24(address, instance, opcode);
+        sendForwardFrame24(address, instance, opcode);
+    }
+
+    /// @brief Send a 24 bit forward frame and wait for the backward frame answering it
+    /// @return Response byte, or 0 if no reply was received
+    virtual uint8_t sendQueryFrame24(uint8_t address, uint8_t instance, uint8_t opcode, unsigned long timeout_ms = 100) {
+        sendForwardFrame24(address, instance, opcode);
+        return receiveBackwardFrame(timeout_ms);
+    }
+
+    /// @brief Send a forward frame and call back with the backward frame once it arrived
+    /// @remark Ports that run the bus from another task override this and return immediately.
+    /// Queries on the same port complete in the order they were issued.
+    virtual void sendQueryFrameAsync(uint8_t address, uint8_t data, DaliQueryCallback callback, unsigned long timeout_ms = 100) {
+        callback(sendQueryFrame(address, data, timeout_ms));
+    }
+
 public:
     virtual void resetBus() { }
 
@@ -232,11 +365,20 @@ public:
     /// @param command Command byte
     /// @return Response byte (0xFF: success, 0x00: failure, or other byte)
     uint8_t sendQueryCommand(short_addr_t addr, DaliCommand command) {
-        sendForwardFrame(
+        return sendQueryFrame(
             (addr << 1) | DALI_COMMAND, 
             static_cast<uint8_t>(command));
+    }
 
-        return receiveBackwardFrame();
+    /// @brief Send a query command without blocking
+    /// @param address Device address, group address, or broadcast
+    /// @param command Command byte
+    /// @param callback Called with the response byte (0xFF: success, 0x00: failure/no reply, or other byte)
+    void sendQueryCommandAsync(short_addr_t addr, DaliCommand command, DaliQueryCallback callback) {
+        sendQueryFrameAsync(
+            (addr << 1) | DALI_COMMAND, 
+            static_cast<uint8_t>(command),
+            std::move(callback));
     }
 
     /// @brief Send a control command to the DALI bus
@@ -245,11 +387,7 @@ public:
     void sendControlCommand(short_addr_t addr, DaliCommand command) {
         // Control commands must send two back to back frames,
         // and will not return a response.
-        sendForwardFrame(
-            (addr << 1) | DALI_COMMAND, 
-            static_cast<uint8_t>(command));
-
-        sendForwardFrame(
+        sendForwardFrameTwice(
             (addr << 1) | DALI_COMMAND, 
             static_cast<uint8_t>(command));
     }
@@ -264,6 +402,13 @@ public:
             static_cast<uint8_t>(data));
     }
 
+    /// @brief Send a special command that must be issued twice (INITIALISE, RANDOMIZE)
+    void sendSpecialCommandTwice(DaliSpecialCommand command, uint8_t data) {
+        sendForwardFrameTwice(
+            static_cast<uint8_t>(command), 
+            static_cast<uint8_t>(data));
+    }
+
     /// @brief Send an extended device command to the DALI bus
     /// @param short_address Device short address
     /// @param device_type See DEVICE_LIGHT_TYPE_* enum. Must not be 0
@@ -273,12 +418,27 @@ public:
             DaliSpecialCommand::ENABLE_DEVICE_TYPE,
             static_cast<uint8_t>(device_type));
 
-        sendForwardFrame(
+        return sendQueryFrame(
             (addr << 1) | DALI_COMMAND, 
             static_cast<uint8_t>(extended_command));
-        return receiveBackwardFrame();
     };
 
+    /// @brief Send an extended device query without blocking
+    void sendExtendedQueryAsync(short_addr_t addr, DaliDeviceType device_type, uint8_t extended_command, DaliQueryCallback callback) {
+        sendSpecialCommand(
+            DaliSpecialCommand::ENABLE_DEVICE_TYPE,
+            static_cast<uint8_t>(device_type));
+
+        sendQueryFrameAsync(
+            (addr << 1) | DALI_COMMAND, 
+            static_cast<uint8_t>(extended_command),
+            std::move(callback));
+    }
+
+    void sendExtendedQueryAsync(short_addr_t addr, DaliLedCommand led_command, DaliQueryCallback callback) {
+        sendExtendedQueryAsync(addr, DaliDeviceType::LED, static_cast<uint8_t>(led_command), std::move(callback));
+    }
+
     uint8_t sendExtendedQuery(short_addr_t addr, DaliLedCommand led_command) {
         return sendExtendedQuery(addr, DaliDeviceType::LED, static_cast<uint8_t>(led_command));
     }
@@ -296,11 +456,7 @@ public:
             static_cast<uint8_t>(device_type));
 
         // MUST send twice, no response
-        sendForwardFrame(
-            (addr << 1) | DALI_COMMAND, 
-            static_cast<uint8_t>(extended_command));
-
-        sendForwardFrame(
+        sendForwardFrameTwice(
             (addr << 1) | DALI_COMMAND, 
             static_cast<uint8_t>(extended_command));
     };
@@ -338,8 +494,17 @@ public:
         : m_txPin(txPin), m_rxPin(rxPin)
     { }
 
+    /// @brief Time the pin access and delay calls with esp_timer, and derive the delays that give
+    /// DALI_HALF_BIT_NS half-bits on this chip and CPU frequency. Call once from setup, after the
+    /// pins are configured. It takes about 10 ms. Frames are refused until it succeeded.
+    /// @return false if the resulting half-bit is outside the IEC 62386-101 transmitter limits
+    bool calibrate();
+    /// @brief Half-bit sent with the calibrated delays, 0 before calibrate() ran
+    uint32_t getHalfBitNs() const { return m_halfBitNs; }
+
 protected:
     void sendForwardFrame(uint8_t address, uint8_t data) override;
+    void sendForwardFrame24(uint8_t address, uint8_t instance, uint8_t opcode) override;
     uint8_t receiveBackwardFrame(unsigned long timeout_ms = 100) override;
 
 private:
@@ -349,13 +514,116 @@ private:
 
     int m_txPin;
     int m_rxPin;
+    // esp_rom_delay_us() arguments, 0 until calibrated
+    uint32_t m_halfBitDelay = 0;
+    uint32_t m_bitDelay = 0;
+    uint32_t m_halfBitNs = 0;
+    bool m_calibrated = false;
+};
+
+/// @brief Gear properties that only change when they are written
+enum class DaliAttribute : uint8_t {
+    MIN_LEVEL,
+    MAX_LEVEL,
+    POWER_ON_LEVEL,
+    DEVICE_TYPE,
+    COLOR_FEATURES,
+    FADE_TIME_FADE_RATE,
+    COUNT
+};
+
+/// @brief Per short address cache of slow-changing gear properties, so they cost one query per boot
+/// @remark The setters that change a property invalidate it. A reply of 0 can not be told apart from
+/// no reply, so 0 is only cached for devices that already answered another query with a non-zero byte.
+/// @remark Used from the bus task and the main loop. The tables are guarded by a spinlock that is
+/// never held across a query, and a reply is dropped if anything was invalidated while it was pending.
+class DaliAttributeCache {
+public:
+    /// @brief Return the cached value, or query it with fetch() and cache the reply
+    /// @remark Group and broadcast addresses are never cached
+    template<typename F> uint8_t get(short_addr_t addr, DaliAttribute attribute, F fetch) {
+        if (addr > ADDR_SHORT_MAX) {
+            return fetch();
+        }
+        uint8_t bit = 1 << static_cast<uint8_t>(attribute);
+        portENTER_CRITICAL(&m_lock);
+        if (m_valid[addr] & bit) {
+            uint8_t value = m_values[addr][static_cast<uint8_t>(attribute)];
+            portEXIT_CRITICAL(&m_lock);
+            return value;
+        }
+        uint32_t generation = m_generation;
+        portEXIT_CRITICAL(&m_lock);
+
+        uint8_t value = fetch();
+
+        portENTER_CRITICAL(&m_lock);
+        if (generation == m_generation) {
+            if (value != 0) {
+                m_answered |= 1ull << addr;
+            }
+            if (value != 0 || (m_answered & (1ull << addr))) {
+                m_values[addr][static_cast<uint8_t>(attribute)] = value;
+                m_valid[addr] |= bit;
+            }
+        }
+        portEXIT_CRITICAL(&m_lock);
+        return value;
+    }
+
+    /// @brief Forget one property, of every device if addr is a group or broadcast address
+    void invalidate(short_addr_t addr, DaliAttribute attribute) {
+        uint8_t bit = 1 << static_cast<uint8_t>(attribute);
+        portENTER_CRITICAL(&m_lock);
+        m_generation++;
+        if (addr > ADDR_SHORT_MAX) {
+            for (int i = 0; i <= ADDR_SHORT_MAX; i++) {
+                m_valid[i] &= ~bit;
+            }
+        } else {
+            m_valid[addr] &= ~bit;
+        }
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+    /// @brief Forget all properties of a device, of every device if addr is a group or broadcast address
+    void invalidate(short_addr_t addr) {
+        if (addr > ADDR_SHORT_MAX) {
+            clear();
+            return;
+        }
+        portENTER_CRITICAL(&m_lock);
+        m_generation++;
+        m_valid[addr] = 0;
+        m_answered &= ~(1ull << addr);
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+    void clear() {
+        portENTER_CRITICAL(&m_lock);
+        m_generation++;
+        for (int i = 0; i <= ADDR_SHORT_MAX; i++) {
+            m_valid[i] = 0;
+        }
+        m_answered = 0;
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+private:
+    portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    uint8_t m_values[ADDR_SHORT_MAX+1][static_cast<uint8_t>(DaliAttribute::COUNT)];
+    uint8_t m_valid[ADDR_SHORT_MAX+1] = {0}; ///< Bit per DaliAttribute
+    uint64_t m_answered = 0;
+    /// @brief Bumped by every invalidation, a reply fetched across one is not cached
+    uint32_t m_generation = 0;
 };
 
 /// @brief Bus manager for handling bus addresses
 class DaliBusManager {
 public:
-DaliBusManager(DaliPort& port)
+DaliBusManager(DaliPort& port, DaliAttributeCache& cache)
         : port(port)
+        , cache(cache)
     { }
 
     /// @brief Put a device into intialisation mode.
@@ -366,14 +634,12 @@ DaliBusManager(DaliPort& port)
         // 0000 0000 : All devices
         // 0AAA AAA1 : Only devices with this address
         // 1111 1111 : Only devices without a short address
-        port.sendSpecialCommand(DaliSpecialCommand::INITIALISE, addr);
-        port.sendSpecialCommand(DaliSpecialCommand::INITIALISE, addr);
+        port.sendSpecialCommandTwice(DaliSpecialCommand::INITIALISE, addr);
     }
 
     /// @brief Tell all devices in initialize mode to randomize their addresses.
     void randomize() {
-        port.sendSpecialCommand(DaliSpecialCommand::RANDOMIZE, 0);
-        port.sendSpecialCommand(DaliSpecialCommand::RANDOMIZE, 0);
+        port.sendSpecialCommandTwice(DaliSpecialCommand::RANDOMIZE, 0);
     }
 
     /// @brief Test if the new randomized address is <= the address programmed in SEARCH[H,M,L].
@@ -382,10 +648,8 @@ DaliBusManager(DaliPort& port)
         port.sendSpecialCommand(DaliSpecialCommand::SEARCH_ADDRM, (search_address >> 8) & 0xFF);  // Set SEARCHM
         port.sendSpecialCommand(DaliSpecialCommand::SEARCH_ADDRL, search_address & 0xFF);         // Set SEARCHL
 
-        port.sendSpecialCommand(DaliSpecialCommand::COMPARE, 0);
-
         const unsigned long timeout_ms = 10;
-        return (port.receiveBackwardFrame(timeout_ms) == 0xFF);
+        return (port.sendQueryFrame(static_cast<uint8_t>(DaliSpecialCommand::COMPARE), 0, timeout_ms) == 0xFF);
     }
 
     /// @brief Tell the device matching the address in SEARCH[H,M,L] to ignore the COMPARE command from now on.
@@ -399,22 +663,42 @@ DaliBusManager(DaliPort& port)
 
     /// @brief Exit the initialization mode.
     void terminate() {
-        port.sendSpecialCommand(DaliSpecialCommand::TERMINATE, 0);
-        port.sendSpecialCommand(DaliSpecialCommand::TERMINATE, 0);
+        port.sendSpecialCommandTwice(DaliSpecialCommand::TERMINATE, 0);
     }
 
     bool programShortAddress(uint8_t addr) {
+        // Another device may have had this address before
+        cache.invalidate(addr & 0x3F);
         addr = ((addr & 0x3F) << 1) | DALI_COMMAND;
         port.sendSpecialCommand(DaliSpecialCommand::PROGRAM_SHORT_ADDRESS, addr);
 
-        port.sendSpecialCommand(DaliSpecialCommand::VERIFY_SHORT_ADDRESS, addr);
-        return (port.receiveBackwardFrame() == 0xFF);
+        return (port.sendQueryFrame(static_cast<uint8_t>(DaliSpecialCommand::VERIFY_SHORT_ADDRESS), addr) == 0xFF);
     }
 
     void clearShortAddress() {
         port.sendSpecialCommand(DaliSpecialCommand::PROGRAM_SHORT_ADDRESS, 0x7F);
     }
 
+    /// @brief Move an addressed device to another short address, without initialisation mode
+    /// @param short_addr Current short address
+    /// @param new_addr New short address 0..63, or 0xFF to delete the short address
+    /// @return true if the device answers at its new address (or no longer at the old one)
+    bool changeShortAddress(short_addr_t short_addr, short_addr_t new_addr) {
+        if (new_addr != 0xFF && isControlGearPresent(new_addr)) {
+            DALI_LOGE("Short address %d is already in use", new_addr);
+            return false;
+        }
+
+        port.setDtr0(new_addr == 0xFF ? 0xFF : ((new_addr & 0x3F) << 1) | DALI_COMMAND);
+        port.sendControlCommand(short_addr, DaliCommand::SET_SHORT_ADDRESS_DTR0);
+        cache.invalidate(short_addr);
+        if (new_addr != 0xFF) {
+            cache.invalidate(new_addr);
+        }
+
+        return new_addr == 0xFF ? !isControlGearPresent(short_addr) : isControlGearPresent(new_addr);
+    }
+
     /// @brief Automatically assign sequential short addresses to all devices on the DALI bus
     /// @param assign ASSIGN_ALL, ASSIGN_UNINITIALIZED, or the short address for a specific device
     /// @return The number of devices found on the bus
@@ -442,15 +726,34 @@ DaliBusManager(DaliPort& port)
         return addr;
     }
 
+    /// @brief Query the 24-bit random address without blocking
+    /// @remark All three queries are issued back to back, the callback runs once the last one completed.
+    void queryAddressAsync(short_addr_t short_addr, std::function<void(uint32_t long_addr)> callback) {
+        // Queries on a port complete in order, so H and M have been stored when L arrives
+        auto addr = std::make_shared<uint32_t>(0);
+        port.sendQueryCommandAsync(short_addr, DaliCommand::QUERY_RANDOM_ADDRESS_H, [addr](uint8_t reply) {
+            *addr |= (uint32_t)reply << 16;
+        });
+        port.sendQueryCommandAsync(short_addr, DaliCommand::QUERY_RANDOM_ADDRESS_M, [addr](uint8_t reply) {
+            *addr |= (uint32_t)reply << 8;
+        });
+        port.sendQueryCommandAsync(short_addr, DaliCommand::QUERY_RANDOM_ADDRESS_L, [addr, callback](uint8_t reply) {
+            *addr |= (uint32_t)reply;
+            callback(*addr);
+        });
+    }
+
 private:
     DaliPort& port;
+    DaliAttributeCache& cache;
     bool _is_scanning = false;
 };
 
 class DaliLamp {
 public:
-    DaliLamp(DaliPort& port)
+    DaliLamp(DaliPort& port, DaliAttributeCache& cache)
         : port(port)
+        , cache(cache)
     { }
 
     /// @brief Set brightness via Direct Arc Power Control (DAPC)
@@ -486,6 +789,28 @@ public:
         port.sendControlCommand(short_addr, DaliCommand::DOWN);
     }
 
+    /// @brief Fade up at the fade rate until the max level is reached
+    /// @remark A level command, sent once. Any level command (e.g. DAPC 255) stops the fade.
+    void continuousUp(short_addr_t short_addr = ADDR_BROADCAST) {
+        port.sendForwardFrame((short_addr << 1) | DALI_COMMAND, static_cast<uint8_t>(DaliCommand::CONTINUOUS_UP));
+    }
+
+    /// @brief Fade down at the fade rate until the min level is reached
+    /// @remark A level command, sent once
+    void continuousDown(short_addr_t short_addr = ADDR_BROADCAST) {
+        port.sendForwardFrame((short_addr << 1) | DALI_COMMAND, static_cast<uint8_t>(DaliCommand::CONTINUOUS_DOWN));
+    }
+
+    /// @brief Switch on at the min level if off, otherwise step the level up by one
+    void onAndStepUp(short_addr_t short_addr = ADDR_BROADCAST) {
+        port.sendForwardFrame((short_addr << 1) | DALI_COMMAND, static_cast<uint8_t>(DaliCommand::ON_AND_STEP_UP));
+    }
+
+    /// @brief Stop a running fade at the current level (DAPC 255, MASK)
+    void stopFade(short_addr_t short_addr = ADDR_BROADCAST) {
+        port.sendForwardFrame(short_addr << 1, 0xFF);
+    }
+
     /// @brief Set brightness to maximum
     /// @param short_addr 
     void fadeToMaximum(short_addr_t short_addr = ADDR_BROADCAST) {
@@ -508,6 +833,7 @@ public:
     /// @param fade_time 0..15 (0 -> disable fade)
     void setFadeTime(short_addr_t short_addr, uint8_t fade_time) {
         fade_time &= 0x0F;
+        cache.invalidate(short_addr, DaliAttribute::FADE_TIME_FADE_RATE);
         port.setDtr0(fade_time);
         port.sendControlCommand(short_addr, DaliCommand::SET_FADE_TIME_DTR0);
     }
@@ -518,6 +844,7 @@ public:
     /// @param fade_rate 1..15
     void setFadeRate(short_addr_t short_addr, uint8_t fade_rate) {
         fade_rate &= 0x0F;
+        cache.invalidate(short_addr, DaliAttribute::FADE_TIME_FADE_RATE);
         port.setDtr0(fade_rate);
         port.sendControlCommand(short_addr, DaliCommand::SET_FADE_RATE_DTR0);
 
@@ -531,6 +858,7 @@ public:
     /// @param short_addr Device short address
     /// @param power_on_level min..max, or 0
     void setPowerOnLevel(short_addr_t short_addr, uint8_t power_on_level) {
+        cache.invalidate(short_addr, DaliAttribute::POWER_ON_LEVEL);
         port.setDtr0(power_on_level);
         if (port.getDtr0(short_addr) != power_on_level) {
             //Serial.println("WARNING: DTR0 not updated!");
@@ -553,21 +881,27 @@ public:
     /// @param short_addr Device short address
     /// @return 1..254
     uint8_t getMinLevel(short_addr_t short_addr) {
-        return port.sendQueryCommand(short_addr, DaliCommand::QUERY_MIN_LEVEL);
+        return cache.get(short_addr, DaliAttribute::MIN_LEVEL, [&]() {
+            return port.sendQueryCommand(short_addr, DaliCommand::QUERY_MIN_LEVEL);
+        });
     }
 
     /// @brief Get the maximum allowable brightness level (usually 254)
     /// @param short_addr Device short address
     /// @return 1..254
     uint8_t getMaxLevel(short_addr_t short_addr) {
-        return port.sendQueryCommand(short_addr, DaliCommand::QUERY_MAX_LEVEL);
+        return cache.get(short_addr, DaliAttribute::MAX_LEVEL, [&]() {
+            return port.sendQueryCommand(short_addr, DaliCommand::QUERY_MAX_LEVEL);
+        });
     }
 
     /// @brief Get the configured default power-on level
     /// @param short_addr Device short address
     /// @return 1..254
     uint8_t getPowerOnLevel(short_addr_t short_addr) {
-        return port.sendQueryCommand(short_addr, DaliCommand::QUERY_POWER_ON_LEVEL);
+        return cache.get(short_addr, DaliAttribute::POWER_ON_LEVEL, [&]() {
+            return port.sendQueryCommand(short_addr, DaliCommand::QUERY_POWER_ON_LEVEL);
+        });
     }
 
     /// @brief Get the current brightness level
@@ -577,7 +911,26 @@ public:
         return port.sendQueryCommand(short_addr, DaliCommand::QUERY_ACTUAL_LEVEL);
     }
 
+    /// @brief Get the gear status
+    /// @param short_addr Device short address
+    /// @return STATUS_* bits
+    uint8_t getStatus(short_addr_t short_addr) {
+        return port.sendQueryCommand(short_addr, DaliCommand::QUERY_STATUS);
+    }
+
+    /// @brief Get the configured fade time and fade rate in a single query
+    /// @param short_addr Device short address
+    /// @return Upper nibble: fade time 0..15, lower nibble: fade rate 1..15
+    uint8_t getFadeTimeFadeRate(short_addr_t short_addr) {
+        return cache.get(short_addr, DaliAttribute::FADE_TIME_FADE_RATE, [&]() {
+            return port.sendQueryCommand(short_addr, DaliCommand::QUERY_FADE_TIME_FADE_RATE);
+        });
+    }
+
     void setMinLevel(short_addr_t short_addr, uint8_t level) {
+        // The gear clamps the new limit, and the power-on level to it
+        cache.invalidate(short_addr, DaliAttribute::MIN_LEVEL);
+        cache.invalidate(short_addr, DaliAttribute::POWER_ON_LEVEL);
         port.setDtr0(level);
         if (port.getDtr0(short_addr) != level) {
             DALI_LOGE("WARNING: DTR0 not updated!");
@@ -587,6 +940,8 @@ public:
     }
 
     void setMaxLevel(short_addr_t short_addr, uint8_t level) {
+        cache.invalidate(short_addr, DaliAttribute::MAX_LEVEL);
+        cache.invalidate(short_addr, DaliAttribute::POWER_ON_LEVEL);
         port.setDtr0(level);
         if (port.getDtr0(short_addr) != level) {
             DALI_LOGE("WARNING: DTR0 not updated!");
@@ -597,6 +952,7 @@ public:
 
 private:
     DaliPort& port;
+    DaliAttributeCache& cache;
 };
 
 class DaliLedClass {
@@ -626,6 +982,15 @@ public:
         port.sendExtendedCommand(addr, DaliLedCommand::STORE_DTR_AS_FAST_FADE_TIME);
     }
 
+    /// @brief Query all LED failure flags at once (LED_FAILURE_*)
+    uint8_t getFailureStatus(short_addr_t addr) {
+        return port.sendExtendedQuery(addr, DaliLedCommand::QUERY_FAILURE_STATUS);
+    }
+
+    void getFailureStatusAsync(short_addr_t addr, DaliQueryCallback callback) {
+        port.sendExtendedQueryAsync(addr, DaliLedCommand::QUERY_FAILURE_STATUS, std::move(callback));
+    }
+
 private:
     DaliPort& port;
 };
@@ -707,6 +1072,7 @@ enum class DaliColorParam : uint8_t {
 };
 
 #define STATUS_BALLAST_OK (0x01)
+#define STATUS_GEAR_FAILURE (0x01) // Same bit as STATUS_BALLAST_OK, set when the control gear reports a failure
 #define STATUS_LAMP_FAILURE (0x02)
 #define STATUS_LAMP_ON (0x04)
 #define STATUS_LIMIT_ERROR (0x08)
@@ -715,6 +1081,38 @@ enum class DaliColorParam : uint8_t {
 #define STATUS_MISSING_SHORT_ADDRESS (0x40)
 #define STATUS_POWER_FAILURE (0x80)
 
+// DaliLedCommand::QUERY_FAILURE_STATUS
+#define LED_FAILURE_SHORT_CIRCUIT (0x01)
+#define LED_FAILURE_OPEN_CIRCUIT (0x02)
+#define LED_FAILURE_LOAD_DECREASE (0x04)
+#define LED_FAILURE_LOAD_INCREASE (0x08)
+#define LED_FAILURE_CURRENT_PROTECTOR_ACTIVE (0x10)
+#define LED_FAILURE_THERMAL_SHUTDOWN (0x20)
+#define LED_FAILURE_THERMAL_OVERLOAD (0x40)
+#define LED_FAILURE_REFERENCE_MEASUREMENT_FAILED (0x80)
+
+// IEC 62386-103 event messages from input devices: 24 bit forward frames with bit 16 cleared.
+// Device/instance addressing: 0AAAAAA0 1IIIIIEE EEEEEEEE (A: short address, I: instance number, E: event info)
+#define DALI_EVENT_IS_EVENT(frame) (((frame) & 0x010000) == 0)
+#define DALI_EVENT_IS_DEVICE_INSTANCE(frame) (((frame) & 0x808000) == 0x008000)
+#define DALI_EVENT_SHORT_ADDRESS(frame) (((frame) >> 17) & 0x3F)
+#define DALI_EVENT_INSTANCE(frame) (((frame) >> 10) & 0x1F)
+#define DALI_EVENT_INFO(frame) ((frame) & 0x3FF)
+
+// IEC 62386-301 push button event info
+#define BUTTON_EVENT_RELEASED (0x00)
+#define BUTTON_EVENT_PRESSED (0x01)
+#define BUTTON_EVENT_SHORT_PRESS (0x02)
+#define BUTTON_EVENT_DOUBLE_PRESS (0x05)
+#define BUTTON_EVENT_LONG_PRESS_START (0x09)
+#define BUTTON_EVENT_LONG_PRESS_REPEAT (0x0A)
+#define BUTTON_EVENT_LONG_PRESS_STOP (0x0B)
+#define BUTTON_EVENT_FREE (0x0E)
+#define BUTTON_EVENT_STUCK (0x0F)
+
+// IEC 62386-303 occupancy sensor event info
+#define OCCUPANCY_EVENT_OCCUPIED (0x02) // Cleared when vacant
+
 // ECMD_COLOR_QUERY_FEATURES
 #define COLOR_FEATURE_XY_CAPABLE (0x01)
 #define COLOR_FEATURE_TC_CAPABLE (0x02)
@@ -736,8 +1134,9 @@ enum class DaliColorParam : uint8_t {
 
 class DaliColorClass {
 public:
-    DaliColorClass(DaliPort& port)
+    DaliColorClass(DaliPort& port, DaliAttributeCache& cache)
         : port(port)
+        , cache(cache)
     { }
 
     bool supportsExtendedColor(short_addr_t short_addr) {
@@ -748,14 +1147,21 @@ public:
     /// @param short_addr 
     /// @return 
     bool isTcCapable(short_addr_t short_addr) {
-        return (port.sendExtendedQuery(short_addr, DaliColorCommand::QUERY_COLOR_FEATURES) & (uint8_t)DaliColorFeature::TC_CAPABLE) != 0;
+        return (getColorFeatures(short_addr) & (uint8_t)DaliColorFeature::TC_CAPABLE) != 0;
     }
 
     /// @brief Supports XY color coordinates
     /// @param short_addr 
     /// @return 
     bool isXYCapable(short_addr_t short_addr) {
-        return (port.sendExtendedQuery(short_addr, DaliColorCommand::QUERY_COLOR_FEATURES) & (uint8_t)DaliColorFeature::XY_CAPABLE) != 0;
+        return (getColorFeatures(short_addr) & (uint8_t)DaliColorFeature::XY_CAPABLE) != 0;
+    }
+
+    /// @brief DaliColorFeature bits, 0 for gear without DT8
+    uint8_t getColorFeatures(short_addr_t short_addr) {
+        return cache.get(short_addr, DaliAttribute::COLOR_FEATURES, [&]() {
+            return port.sendExtendedQuery(short_addr, DaliColorCommand::QUERY_COLOR_FEATURES);
+        });
     }
 
     // TODO: RGB??
@@ -804,6 +1210,7 @@ public:
 
 private:
     DaliPort& port;
+    DaliAttributeCache& cache;
 };
 
 class DaliScene {
@@ -829,6 +1236,15 @@ public:
         port.sendControlCommand(short_addr, cmd);
     }
 
+    /// @brief Get the groups a device is a member of
+    /// @param short_addr Device short address
+    /// @return Bit n set = member of group n
+    uint16_t getGroups(short_addr_t short_addr) {
+        uint8_t low = port.sendQueryCommand(short_addr, DaliCommand::QUERY_GROUPS_0_7);
+        uint8_t high = port.sendQueryCommand(short_addr, DaliCommand::QUERY_GROUPS_8_15);
+        return ((uint16_t)high << 8) | low;
+    }
+
     /// @brief Activate a scene
     /// @remark Fade to the brightness level stored for the scene ID
     /// @param short_addr Device or group short address
@@ -860,17 +1276,325 @@ private:
     DaliPort& port;
 };
 
+// Identification, memory bank 0 (IEC 62386-102)
+#define MEMORY_BANK_IDENTITY (0)
+#define IDENTITY_GTIN (0x03) // 6 bytes, MSB first
+#define IDENTITY_FIRMWARE_VERSION (0x09) // major, minor
+#define IDENTITY_SERIAL (0x0B) // 8 bytes, MSB first (4 bytes on DALI-1 gear)
+#define IDENTITY_HARDWARE_VERSION (0x13) // major, minor, DALI-2 only
+#define IDENTITY_VERSION_DALI2 (0x08) // QUERY_VERSION_NUMBER of DALI-2 gear, version 2.0
+
+/// @brief Identification data from memory bank 0
+struct DaliIdentity {
+    uint64_t gtin;
+    uint64_t serial;
+    uint8_t firmware_major;
+    uint8_t firmware_minor;
+    uint8_t hardware_major;
+    uint8_t hardware_minor;
+    uint8_t serial_bytes; ///< 8 on DALI-2 gear, 4 on DALI-1
+};
+
+// IEC 62386-252 energy reporting, memory bank 202
+#define MEMORY_BANK_ENERGY (202)
+#define ENERGY_SCALE_ACTIVE_ENERGY (0x04)
+#define ENERGY_ACTIVE_ENERGY (0x05) // 6 bytes, MSB first
+#define ENERGY_SCALE_ACTIVE_POWER (0x0B)
+#define ENERGY_ACTIVE_POWER (0x0C) // 4 bytes, MSB first
+
+class DaliMemoryBank {
+public:
+    DaliMemoryBank(DaliPort& port)
+        : port(port)
+    { }
+
+    /// @brief Read consecutive memory bank locations
+    /// @remark DTR1 and DTR0 are set once, READ_MEMORY_LOCATION increments DTR0 after every byte.
+    /// Multi-byte values are latched when their first byte is read, so read them in one go.
+    /// @param short_addr Device short address
+    /// @return false if no location answered (a 0 byte can not be told apart from no reply)
+    bool read(short_addr_t short_addr, uint8_t bank, uint8_t offset, uint8_t* data, uint8_t length) {
+        port.setDtr1(bank);
+        port.setDtr0(offset);
+
+        bool answered = false;
+        for (uint8_t i = 0; i < length; i++) {
+            data[i] = port.sendQueryCommand(short_addr, DaliCommand::READ_MEMORY_LOCATION);
+            answered |= data[i] != 0;
+        }
+        return answered;
+    }
+
+    /// @brief Read the identification of a gear from memory bank 0 in one sequence
+    /// @return false if bank 0 could not be read
+    bool readIdentity(short_addr_t short_addr, DaliIdentity& identity) {
+        uint8_t data[IDENTITY_HARDWARE_VERSION + 2];
+        if (!read(short_addr, MEMORY_BANK_IDENTITY, 0, data, sizeof(data))) {
+            return false;
+        }
+        // The serial layout follows the IEC 62386-102 edition, not the bank size: DALI-1 gear may
+        // store manufacturer data after a 4 byte serial. DALI-2 reports version 2.0 (8) or later.
+        bool dali2 = port.sendQueryCommand(short_addr, DaliCommand::QUERY_VERSION_NUMBER) >= IDENTITY_VERSION_DALI2;
+        identity.serial_bytes = dali2 ? 8 : 4;
+        // Location 0 holds the last accessible location
+        uint8_t last = data[0];
+        if (last < IDENTITY_SERIAL + identity.serial_bytes - 1) {
+            return false;
+        }
+
+        identity.gtin = 0;
+        for (int i = 0; i < 6; i++) {
+            identity.gtin = (identity.gtin << 8) | data[IDENTITY_GTIN + i];
+        }
+        identity.serial = 0;
+        for (int i = 0; i < identity.serial_bytes; i++) {
+            identity.serial = (identity.serial << 8) | data[IDENTITY_SERIAL + i];
+        }
+        identity.firmware_major = data[IDENTITY_FIRMWARE_VERSION];
+        identity.firmware_minor = data[IDENTITY_FIRMWARE_VERSION + 1];
+        bool hardware = dali2 && last >= IDENTITY_HARDWARE_VERSION + 1;
+        identity.hardware_major = hardware ? data[IDENTITY_HARDWARE_VERSION] : 0;
+        identity.hardware_minor = hardware ? data[IDENTITY_HARDWARE_VERSION + 1] : 0;
+        return true;
+    }
+
+    /// @brief Read the lowest two bytes of the serial number, enough to tell if a cached identity still applies
+    /// @param serial_bytes Length of the serial number, from readIdentity()
+    uint16_t readSerialTail(short_addr_t short_addr, uint8_t serial_bytes) {
+        uint8_t data[2];
+        read(short_addr, MEMORY_BANK_IDENTITY, IDENTITY_SERIAL + serial_bytes - 2, data, sizeof(data));
+        return ((uint16_t)data[0] << 8) | data[1];
+    }
+
+    /// @brief Read the energy report of a DALI-2 gear supporting IEC 62386-252
+    /// @param energy_wh Active energy since manufacture
+    /// @param power_w Active power right now
+    /// @return false if the gear does not implement memory bank 202 or has no valid reading
+    bool readEnergy(short_addr_t short_addr, float& energy_wh, float& power_w) {
+        uint8_t data[ENERGY_ACTIVE_POWER + 4];
+        if (!read(short_addr, MEMORY_BANK_ENERGY, 0, data, sizeof(data))) {
+            return false;
+        }
+        // Location 0 holds the last accessible location of the bank
+        if (data[0] < ENERGY_ACTIVE_POWER + 3) {
+            return false;
+        }
+
+        uint64_t energy = 0;
+        for (int i = 0; i < 6; i++) {
+            energy = (energy << 8) | data[ENERGY_ACTIVE_ENERGY + i];
+        }
+        uint32_t power = 0;
+        for (int i = 0; i < 4; i++) {
+            power = (power << 8) | data[ENERGY_ACTIVE_POWER + i];
+        }
+        // All ones marks a value that is not available
+        if (energy == 0xFFFFFFFFFFFFull || power == 0xFFFFFFFFul) {
+            return false;
+        }
+
+        energy_wh = energy * powf(10.0f, (int8_t)data[ENERGY_SCALE_ACTIVE_ENERGY]);
+        power_w = power * powf(10.0f, (int8_t)data[ENERGY_SCALE_ACTIVE_POWER]);
+        return true;
+    }
+
+private:
+    DaliPort& port;
+};
+
+/// @brief Commands for DALI-2 control devices (input devices, application controllers)
+/// @remark Uses 24 bit frames. Addresses are control device short addresses 0..63, which
+/// are separate from the control gear short addresses.
+class DaliControlDevice {
+public:
+    DaliControlDevice(DaliPort& port)
+        : port(port)
+    { }
+
+    /// @brief Make the device identify itself (e.g. flash an LED) for about 10 seconds
+    void identify(short_addr_t short_addr) {
+        sendDeviceCommand(short_addr, DaliDeviceCommand::IDENTIFY_DEVICE, false);
+    }
+
+    void reset(short_addr_t short_addr) {
+        sendDeviceCommand(short_addr, DaliDeviceCommand::RESET, true);
+    }
+
+    /// @brief Commit all settings to non-volatile memory
+    void savePersistentVariables(short_addr_t short_addr) {
+        sendDeviceCommand(short_addr, DaliDeviceCommand::SAVE_PERSISTENT_VARIABLES, true);
+    }
+
+    uint8_t getDeviceStatus(short_addr_t short_addr) {
+        return queryDevice(short_addr, DaliDeviceCommand::QUERY_DEVICE_STATUS);
+    }
+
+    uint8_t getNumberOfInstances(short_addr_t short_addr) {
+        return queryDevice(short_addr, DaliDeviceCommand::QUERY_NUMBER_OF_INSTANCES);
+    }
+
+    /// @brief Instance type, e.g. 1 = push button, 3 = occupancy sensor
+    uint8_t getInstanceType(short_addr_t short_addr, uint8_t instance) {
+        return queryInstance(short_addr, instance, DaliDeviceCommand::QUERY_INSTANCE_TYPE);
+    }
+
+    void enableInstance(short_addr_t short_addr, uint8_t instance) {
+        sendInstanceCommand(short_addr, instance, DaliDeviceCommand::ENABLE_INSTANCE);
+    }
+
+    void disableInstance(short_addr_t short_addr, uint8_t instance) {
+        sendInstanceCommand(short_addr, instance, DaliDeviceCommand::DISABLE_INSTANCE);
+    }
+
+    /// @brief Select how the instance addresses its event frames
+    void setEventScheme(short_addr_t short_addr, uint8_t instance, DaliEventScheme scheme) {
+        setDtr0(static_cast<uint8_t>(scheme));
+        sendInstanceCommand(short_addr, instance, DaliDeviceCommand::SET_EVENT_SCHEME);
+    }
+
+    DaliEventScheme getEventScheme(short_addr_t short_addr, uint8_t instance) {
+        return static_cast<DaliEventScheme>(queryInstance(short_addr, instance, DaliDeviceCommand::QUERY_EVENT_SCHEME));
+    }
+
+    /// @brief Select which events the instance sends, bit meanings depend on the instance type
+    void setEventFilter(short_addr_t short_addr, uint8_t instance, uint32_t filter) {
+        setDtr0(filter & 0xFF);
+        setDtr1((filter >> 8) & 0xFF);
+        setDtr2((filter >> 16) & 0xFF);
+        sendInstanceCommand(short_addr, instance, DaliDeviceCommand::SET_EVENT_FILTER);
+    }
+
+    uint32_t getEventFilter(short_addr_t short_addr, uint8_t instance) {
+        uint32_t filter = queryInstance(short_addr, instance, DaliDeviceCommand::QUERY_EVENT_FILTER_0_7);
+        filter |= (uint32_t)queryInstance(short_addr, instance, DaliDeviceCommand::QUERY_EVENT_FILTER_8_15) << 8;
+        filter |= (uint32_t)queryInstance(short_addr, instance, DaliDeviceCommand::QUERY_EVENT_FILTER_16_23) << 16;
+        return filter;
+    }
+
+    /// @brief Event priority 2 (highest) .. 5 (lowest)
+    void setEventPriority(short_addr_t short_addr, uint8_t instance, uint8_t priority) {
+        setDtr0(priority);
+        sendInstanceCommand(short_addr, instance, DaliDeviceCommand::SET_EVENT_PRIORITY);
+    }
+
+    void setDtr0(uint8_t value) {
+        port.sendForwardFrame24(DEVICE_SPECIAL_ADDR, static_cast<uint8_t>(DaliDeviceSpecialCommand::DTR0), value);
+    }
+    void setDtr1(uint8_t value) {
+        port.sendForwardFrame24(DEVICE_SPECIAL_ADDR, static_cast<uint8_t>(DaliDeviceSpecialCommand::DTR1), value);
+    }
+    void setDtr2(uint8_t value) {
+        port.sendForwardFrame24(DEVICE_SPECIAL_ADDR, static_cast<uint8_t>(DaliDeviceSpecialCommand::DTR2), value);
+    }
+
+private:
+    static uint8_t deviceAddress(short_addr_t short_addr) {
+        return short_addr == ADDR_BROADCAST ? DEVICE_ADDR_BROADCAST : ((short_addr & 0x3F) << 1) | DALI_COMMAND;
+    }
+
+    void sendDeviceCommand(short_addr_t short_addr, DaliDeviceCommand command, bool twice) {
+        if (twice) {
+            port.sendForwardFrame24Twice(deviceAddress(short_addr), DEVICE_INSTANCE_DEVICE, static_cast<uint8_t>(command));
+        } else {
+            port.sendForwardFrame24(deviceAddress(short_addr), DEVICE_INSTANCE_DEVICE, static_cast<uint8_t>(command));
+        }
+    }
+
+    void sendInstanceCommand(short_addr_t short_addr, uint8_t instance, DaliDeviceCommand command) {
+        // All instance configuration commands must be sent twice
+        port.sendForwardFrame24Twice(deviceAddress(short_addr), instance, static_cast<uint8_t>(command));
+    }
+
+    uint8_t queryDevice(short_addr_t short_addr, DaliDeviceCommand command) {
+        return port.sendQueryFrame24(deviceAddress(short_addr), DEVICE_INSTANCE_DEVICE, static_cast<uint8_t>(command));
+    }
+
+    uint8_t queryInstance(short_addr_t short_addr, uint8_t instance, DaliDeviceCommand command) {
+        return port.sendQueryFrame24(deviceAddress(short_addr), instance, static_cast<uint8_t>(command));
+    }
+
+    DaliPort& port;
+};
+
+/// @brief Control gear settings that can be written in a configuration batch
+enum class DaliSetting : uint8_t {
+    FADE_TIME,            ///< 0..15
+    FADE_RATE,            ///< 1..15
+    MIN_LEVEL,
+    MAX_LEVEL,
+    POWER_ON_LEVEL,
+    SYSTEM_FAILURE_LEVEL,
+    ADD_TO_GROUP,         ///< value = group 0..15
+    REMOVE_FROM_GROUP,    ///< value = group 0..15
+};
+
+struct DaliConfigEntry {
+    short_addr_t short_addr;
+    DaliSetting setting;
+    uint8_t value;
+};
+
+/// @brief Reports how many commands of a batch have been sent
+typedef std::function<void(size_t done, size_t total)> DaliProgressCallback;
+
+/// @brief Settings for many devices, written with as few frames as possible
+/// @remark Entries are sorted by value so devices share each DTR0 write. A value shared by
+/// every device of the population is broadcast, one shared by every member of a known group
+/// is sent to the group. Minimum and maximum level are limited against each other by the
+/// gear, move them past each other in two batches.
+class DaliConfigBatch {
+public:
+    /// @brief Add a setting for one device. A later entry for the same setting replaces an earlier one.
+    /// @param short_addr Device short address 0..63
+    void set(short_addr_t short_addr, DaliSetting setting, uint8_t value);
+
+    /// @brief Devices on the bus, bit n = short address n. Enables broadcasts.
+    void setPopulation(uint64_t devices) {
+        m_population = devices;
+    }
+
+    /// @brief Current members of a group, bit n = short address n. Enables group addressing.
+    /// @remark Groups changed by this batch are never used for addressing.
+    void setGroupMembers(uint8_t group, uint64_t members) {
+        m_groups[group & 0x0F] = members;
+    }
+
+    size_t size() const { return m_entries.size(); }
+    void clear() { m_entries.clear(); }
+
+private:
+    friend class DaliMaster;
+
+    struct Step {
+        DaliCommand command;
+        short_addr_t addr;
+        bool dtr0;     ///< Command takes its value from DTR0
+        uint8_t value; ///< DTR0 value
+    };
+
+    /// @brief Turn the entries into commands, DTR0 users ordered by value
+    void plan(std::vector<Step>& steps) const;
+    /// @brief Add commands covering every device in mask with the fewest addresses
+    void cover(std::vector<Step>& steps, uint64_t mask, const Step& step, uint16_t changed_groups) const;
+
+    std::vector<DaliConfigEntry> m_entries;
+    uint64_t m_population = 0;
+    uint64_t m_groups[16] = {0};
+};
+
 /// @brief Dali Bus Master
 class DaliMaster {
 public:
     DaliMaster(DaliPort& port)
         : active_addr(ADDR_BROADCAST)
         , port(port)
-        , bus_manager(port)
-        , lamp(port)
+        , bus_manager(port, attributes)
+        , lamp(port, attributes)
         , led(port)
-        , color(port)
+        , color(port, attributes)
         , scene(port)
+        , memory(port)
+        , device(port)
     { }
 
 public:
@@ -895,8 +1619,29 @@ public:
         return (port.sendQueryCommand(short_addr, DaliCommand::QUERY_CONTROL_GEAR_PRESENT) != 0);
     }
 
+    /// @brief Get the device type of the gear (DaliDeviceType), 0xFF if it supports several
+    uint8_t getDeviceType(short_addr_t short_addr) {
+        return attributes.get(short_addr, DaliAttribute::DEVICE_TYPE, [&]() {
+            return port.sendQueryCommand(short_addr, DaliCommand::QUERY_DEVICE_TYPE);
+        });
+    }
+
+    /// @brief Fill the attribute cache of these devices in one sweep
+    /// @param devices Bit n = short address n
+    /// @return Number of devices that answered
+    uint8_t warmAttributes(uint64_t devices);
+
+    /// @brief Issue a query without blocking
+    /// @param short_addr Device or group short address, or ADDR_BROADCAST
+    /// @param command Query command
+    /// @param callback Called with the response byte once it arrived (0 if there was no reply)
+    void queryAsync(short_addr_t short_addr, DaliCommand command, DaliQueryCallback callback) {
+        port.sendQueryCommandAsync(short_addr, command, std::move(callback));
+    }
+
     void reset(short_addr_t short_addr) {
         port.sendControlCommand(short_addr, DaliCommand::DALI_RESET);
+        attributes.invalidate(short_addr);
     }
 
     /// @brief Commit all settings to non-volatile memory
@@ -911,14 +1656,27 @@ public:
         port.sendControlCommand(short_addr, DaliCommand::IDENTIFY_DEVICE);
     }
 
+    /// @brief Write a batch of settings
+    /// @param progress Called after every command, may be null
+    /// @return Number of commands sent, counting each DTR0 write
+    size_t configure(const DaliConfigBatch& batch, DaliProgressCallback progress = nullptr);
+
     void dumpStatusForDevice(uint8_t addr);
 
+private:
+    /// @brief Drop cached attributes a configuration command changes
+    void invalidateAttributes(short_addr_t addr, DaliCommand command);
+
 public:
     short_addr_t active_addr;
     DaliPort& port;
+    /// @brief Declared before the classes that hold a reference to it
+    DaliAttributeCache attributes;
     DaliBusManager bus_manager;
     DaliLamp lamp;
     DaliLedClass led;
     DaliColorClass color;
     DaliScene scene;
+    DaliMemoryBank memory;
+    DaliControlDevice device;
 };
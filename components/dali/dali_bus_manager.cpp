@@ -89,8 +89,7 @@ uint8_t DaliBusManager::autoAssignShortAddresses(uint8_t assign, bool reset) {
         }
 
         // Verify
-        port.sendSpecialCommand(DaliSpecialCommand::VERIFY_SHORT_ADDRESS, short_addr | DALI_COMMAND);
-        if (port.receiveBackwardFrame() == 0xFF) {
+        if (port.sendQueryFrame(static_cast<uint8_t>(DaliSpecialCommand::VERIFY_SHORT_ADDRESS), short_addr | DALI_COMMAND) == 0xFF) {
             DALI_LOGD("Short address: %.2x", short_addr);
 
             //m_addresses[count] = addr;
@@ -173,8 +172,7 @@ bool DaliBusManager::findNextAddress(short_addr_t& out_short_addr, uint32_t& out
     out_long_addr = addr;
 
     // Get short address
-    port.sendSpecialCommand(DaliSpecialCommand::QUERY_SHORT_ADDRESS, 0);
-    out_short_addr = port.receiveBackwardFrame();
+    out_short_addr = port.sendQueryFrame(static_cast<uint8_t>(DaliSpecialCommand::QUERY_SHORT_ADDRESS), 0);
     if (out_short_addr == 0) {
         DALI_LOGW("Short address not found for %.6x", addr);
         out_short_addr = 0xFF;
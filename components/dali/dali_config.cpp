@@ -0,0 +1,219 @@
+#include "dali.h"
+#include <algorithm>
+
+static DaliCommand commandForSetting(DaliSetting setting, uint8_t value, bool& dtr0) {
+    dtr0 = true;
+    switch (setting) {
+        case DaliSetting::FADE_TIME: return DaliCommand::SET_FADE_TIME_DTR0;
+        case DaliSetting::FADE_RATE: return DaliCommand::SET_FADE_RATE_DTR0;
+        case DaliSetting::MIN_LEVEL: return DaliCommand::SET_MIN_LEVEL_DTR0;
+        case DaliSetting::MAX_LEVEL: return DaliCommand::SET_MAX_LEVEL_DTR0;
+        case DaliSetting::POWER_ON_LEVEL: return DaliCommand::SET_POWER_ON_LEVEL_DTR0;
+        case DaliSetting::SYSTEM_FAILURE_LEVEL: return DaliCommand::SET_SYSTEM_FAILURE_LEVEL_DTR0;
+        default: break;
+    }
+
+    dtr0 = false;
+    if (setting == DaliSetting::ADD_TO_GROUP) {
+        return static_cast<DaliCommand>((uint8_t)DaliCommand::ADD_TO_GROUP | (value & 0x0F));
+    }
+    return static_cast<DaliCommand>((uint8_t)DaliCommand::REMOVE_FROM_GROUP | (value & 0x0F));
+}
+
+static bool isGroupSetting(DaliSetting setting) {
+    return setting == DaliSetting::ADD_TO_GROUP || setting == DaliSetting::REMOVE_FROM_GROUP;
+}
+
+void DaliConfigBatch::set(short_addr_t short_addr, DaliSetting setting, uint8_t value) {
+    if (short_addr > ADDR_SHORT_MAX) {
+        DALI_LOGW("Configuration batches take device short addresses, ignoring %d", short_addr);
+        return;
+    }
+    if (setting == DaliSetting::FADE_TIME || setting == DaliSetting::FADE_RATE || isGroupSetting(setting)) {
+        value &= 0x0F;
+    }
+
+    for (DaliConfigEntry& entry : m_entries) {
+        if (entry.short_addr != short_addr) {
+            continue;
+        }
+        // Adding to and removing from the same group replace each other, the last write wins.
+        // They can not cancel out, the device may already have been a member before the batch.
+        bool same = isGroupSetting(setting)
+            ? isGroupSetting(entry.setting) && entry.value == value
+            : entry.setting == setting;
+        if (same) {
+            entry.setting = setting;
+            entry.value = value;
+            return;
+        }
+    }
+    m_entries.push_back(DaliConfigEntry { short_addr, setting, value });
+}
+
+void DaliConfigBatch::plan(std::vector<Step>& steps) const {
+    struct Target {
+        DaliSetting setting;
+        uint8_t value;
+        uint64_t mask;
+    };
+
+    std::vector<Target> targets;
+    uint16_t changed_groups = 0;
+    for (const DaliConfigEntry& entry : m_entries) {
+        if (isGroupSetting(entry.setting)) {
+            changed_groups |= 1 << entry.value;
+        }
+
+        auto it = std::find_if(targets.begin(), targets.end(), [&](const Target& t) {
+            return t.setting == entry.setting && t.value == entry.value;
+        });
+        if (it == targets.end()) {
+            targets.push_back(Target { entry.setting, entry.value, 0 });
+            it = targets.end() - 1;
+        }
+        it->mask |= 1ull << entry.short_addr;
+    }
+
+    // Settings taken from DTR0 first, grouped by value so each value is written once
+    std::sort(targets.begin(), targets.end(), [](const Target& a, const Target& b) {
+        bool a_group = isGroupSetting(a.setting);
+        bool b_group = isGroupSetting(b.setting);
+        if (a_group != b_group) {
+            return b_group;
+        }
+        if (a.value != b.value) {
+            return a.value < b.value;
+        }
+        return a.setting < b.setting;
+    });
+
+    for (const Target& target : targets) {
+        Step step;
+        step.command = commandForSetting(target.setting, target.value, step.dtr0);
+        step.value = target.value;
+        cover(steps, target.mask, step, changed_groups);
+    }
+}
+
+void DaliConfigBatch::cover(std::vector<Step>& steps, uint64_t mask, const Step& step, uint16_t changed_groups) const {
+    if (m_population != 0 && (mask & m_population) == m_population) {
+        Step broadcast = step;
+        broadcast.addr = ADDR_BROADCAST;
+        steps.push_back(broadcast);
+        return;
+    }
+
+    uint64_t remaining = mask;
+    for (;;) {
+        // Largest group whose members all take this value
+        int best = -1;
+        int best_count = 1;
+        for (int group = 0; group < 16; group++) {
+            uint64_t members = m_groups[group];
+            if (members == 0 || (members & ~mask) != 0 || (changed_groups & (1 << group))) {
+                continue;
+            }
+            int count = __builtin_popcountll(members & remaining);
+            if (count > best_count) {
+                best = group;
+                best_count = count;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        Step group = step;
+        group.addr = ADDR_GROUP | best;
+        steps.push_back(group);
+        remaining &= ~m_groups[best];
+    }
+
+    for (short_addr_t addr = 0; remaining != 0; addr++, remaining >>= 1) {
+        if (remaining & 1) {
+            Step single = step;
+            single.addr = addr;
+            steps.push_back(single);
+        }
+    }
+}
+
+void DaliMaster::invalidateAttributes(short_addr_t addr, DaliCommand command) {
+    switch (command) {
+        case DaliCommand::SET_MIN_LEVEL_DTR0:
+        case DaliCommand::SET_MAX_LEVEL_DTR0:
+            // The gear clamps the power-on level to the new limits
+            attributes.invalidate(addr, command == DaliCommand::SET_MIN_LEVEL_DTR0 ? DaliAttribute::MIN_LEVEL : DaliAttribute::MAX_LEVEL);
+            attributes.invalidate(addr, DaliAttribute::POWER_ON_LEVEL);
+            break;
+        case DaliCommand::SET_POWER_ON_LEVEL_DTR0:
+            attributes.invalidate(addr, DaliAttribute::POWER_ON_LEVEL);
+            break;
+        case DaliCommand::SET_FADE_TIME_DTR0:
+        case DaliCommand::SET_FADE_RATE_DTR0:
+            attributes.invalidate(addr, DaliAttribute::FADE_TIME_FADE_RATE);
+            break;
+        default:
+            break;
+    }
+}
+
+uint8_t DaliMaster::warmAttributes(uint64_t devices) {
+    uint8_t answered = 0;
+    for (short_addr_t addr = 0; devices != 0; addr++, devices >>= 1) {
+        if (!(devices & 1)) {
+            continue;
+        }
+        // A device that does not answer its min level is not there, skip the rest of its queries
+        if (lamp.getMinLevel(addr) == 0) {
+            continue;
+        }
+        answered++;
+        lamp.getMaxLevel(addr);
+        lamp.getPowerOnLevel(addr);
+        uint8_t type = getDeviceType(addr);
+        if (type == static_cast<uint8_t>(DaliDeviceType::COLOR) || type == 0xFF) {
+            color.getColorFeatures(addr);
+        }
+    }
+    return answered;
+}
+
+size_t DaliMaster::configure(const DaliConfigBatch& batch, DaliProgressCallback progress) {
+    std::vector<DaliConfigBatch::Step> steps;
+    batch.plan(steps);
+
+    size_t total = steps.size();
+    int dtr0 = -1;
+    for (const auto& step : steps) {
+        if (step.dtr0 && step.value != dtr0) {
+            dtr0 = step.value;
+            total++;
+        }
+    }
+
+    size_t done = 0;
+    dtr0 = -1;
+    for (const auto& step : steps) {
+        if (step.dtr0 && step.value != dtr0) {
+            // DTR0 is shared by every device on the bus
+            port.setDtr0(step.value);
+            dtr0 = step.value;
+            done++;
+            if (progress) {
+                progress(done, total);
+            }
+        }
+
+        port.sendControlCommand(step.addr, step.command);
+        invalidateAttributes(step.addr, step.command);
+        done++;
+        if (progress) {
+            progress(done, total);
+        }
+    }
+
+    DALI_LOGI("Configuration batch: %d settings in %d commands", (int)batch.size(), (int)total);
+    return total;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+
+/// @brief Where a logged frame came from
+enum class DaliFrameSource : uint8_t {
+    BUS, ///< Decoded from the RX line, may have been sent by another master or a control gear
+    TX,  ///< Forward frame sent by this node
+    RX,  ///< Backward frame received by this node in reply to a query
+};
+
+/// @brief Frame log entry
+struct DaliFrameRecord {
+    int64_t time_us;        ///< Start of the frame (esp_timer clock)
+    uint32_t data;          ///< Frame bits, right aligned
+    uint8_t bits;           ///< 8 = backward frame, 16 or 24 = forward frame, 0 = no reply
+    DaliFrameSource source;
+    bool error;             ///< Manchester violation or unexpected frame length
+};
+
+/// @brief Level change on the RX line
+struct DaliEdge {
+    uint32_t time_us;
+    bool active; ///< Line level after the edge, true = bus pulled low
+};
+
+/// @brief Decodes Manchester encoded frames from RX line edges
+/// @remark Edge durations are rounded to half-bits with the receiver tolerances of
+/// IEC 62386-101 (333..500us per half-bit, 666..1000us for two). A frame ends once the
+/// line has been idle for longer than any run inside a frame can be.
+class DaliFrameDecoder {
+public:
+    static const uint32_t HALF_BIT_MIN_US = 290;
+    static const uint32_t HALF_BIT_MAX_US = 625;
+    static const uint32_t FULL_BIT_MAX_US = 1040;
+    static const uint32_t STOP_US = 1200;
+    /// @brief START bit plus 24 bits, two half-bits each
+    static const uint8_t MAX_HALF_BITS = 50;
+
+    void reset() {
+        m_inFrame = false;
+    }
+
+    bool inFrame() const { return m_inFrame; }
+
+    /// @brief Feed one edge
+    /// @return true if a frame ended before this edge, it is stored in frame
+    bool edge(const DaliEdge& e, uint32_t& start_us, DaliFrameRecord& frame) {
+        bool finished = false;
+        if (m_inFrame && !m_level && e.time_us - m_lastEdge > STOP_US) {
+            finished = finish(start_us, frame);
+        }
+
+        if (!m_inFrame) {
+            if (e.active) {
+                // START bit
+                m_inFrame = true;
+                m_error = false;
+                m_level = true;
+                m_start = e.time_us;
+                m_lastEdge = e.time_us;
+                m_halves = 0;
+                m_count = 0;
+            }
+            return finished;
+        }
+
+        uint32_t duration = e.time_us - m_lastEdge;
+        uint8_t halves;
+        if (duration < HALF_BIT_MIN_US) {
+            halves = 1;
+            m_error = true;
+        } else if (duration <= HALF_BIT_MAX_US) {
+            halves = 1;
+        } else if (duration <= FULL_BIT_MAX_US) {
+            halves = 2;
+        } else {
+            // Bus held low for too long
+            halves = 2;
+            m_error = true;
+        }
+
+        for (uint8_t i = 0; i < halves; i++) {
+            append(m_level);
+        }
+        m_level = e.active;
+        m_lastEdge = e.time_us;
+        return finished;
+    }
+
+    /// @brief Check for the end of a frame while no edges arrive
+    /// @return true if a frame ended, it is stored in frame
+    bool idle(uint32_t now_us, uint32_t& start_us, DaliFrameRecord& frame) {
+        if (m_inFrame && !m_level && now_us - m_lastEdge > STOP_US) {
+            return finish(start_us, frame);
+        }
+        return false;
+    }
+
+private:
+    void append(bool level) {
+        if (m_count >= MAX_HALF_BITS) {
+            m_error = true;
+            return;
+        }
+        m_halves = (m_halves << 1) | (level ? 1 : 0);
+        m_count++;
+    }
+
+    bool finish(uint32_t& start_us, DaliFrameRecord& frame) {
+        m_inFrame = false;
+
+        // The idle second half of a trailing '1' runs into the stop condition
+        if (m_count & 1) {
+            append(false);
+        }
+
+        // '1' is active then idle, '0' is idle then active. The first bit is the START bit.
+        uint32_t data = 0;
+        bool error = m_error;
+        uint8_t bits = m_count / 2;
+        for (int i = bits - 1; i >= 0; i--) {
+            uint8_t pair = (m_halves >> (i * 2)) & 0x3;
+            if (pair == 0x2) {
+                data = (data << 1) | 1;
+            } else if (pair == 0x1) {
+                data = data << 1;
+            } else {
+                error = true;
+            }
+        }
+
+        bits = bits > 0 ? bits - 1 : 0;
+        if (bits != 8 && bits != 16 && bits != 24) {
+            error = true;
+        }
+
+        start_us = m_start;
+        frame.data = data & ~(1ul << bits);
+        frame.bits = bits;
+        frame.source = DaliFrameSource::BUS;
+        frame.error = error;
+        return true;
+    }
+
+    bool m_inFrame = false;
+    bool m_level = false;
+    bool m_error = false;
+    uint32_t m_start = 0;
+    uint32_t m_lastEdge = 0;
+    uint64_t m_halves = 0;
+    uint8_t m_count = 0;
+};
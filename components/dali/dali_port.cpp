@@ -5,13 +5,64 @@
 #define HALF_BIT_PERIOD 416
 #define BIT_PERIOD 833
 
+// Each calibration measurement times a few rounds, the fastest of a few measurements is used
+// so an interrupt in between does not skew it
+#define CALIBRATION_ROUNDS (8)
+#define CALIBRATION_RUNS (4)
+
+template<typename F> static int64_t fastest_round_ns(F round) {
+    int64_t best = INT64_MAX;
+    for (int run = 0; run < CALIBRATION_RUNS; run++) {
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < CALIBRATION_ROUNDS; i++) {
+            round();
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best * 1000 / CALIBRATION_ROUNDS;
+}
+
+bool DaliSerialBitBangPort::calibrate() {
+    // What writeBit() does per half-bit, with the line left idle
+    int64_t write_overhead = fastest_round_ns([this]() {
+        gpio_set_level((gpio_num_t)m_txPin, 0);
+        esp_rom_delay_us(HALF_BIT_PERIOD);
+    }) - HALF_BIT_PERIOD * 1000;
+    int64_t delay = (DALI_HALF_BIT_NS - write_overhead + 500) / 1000;
+    m_halfBitDelay = delay > 1 ? (uint32_t)delay : 1;
+
+    // What readByte() and receiveBackwardFrame() do per bit
+    int64_t read_overhead = fastest_round_ns([this]() {
+        gpio_get_level((gpio_num_t)m_rxPin);
+        esp_rom_delay_us(BIT_PERIOD);
+    }) - BIT_PERIOD * 1000;
+    delay = (2 * DALI_HALF_BIT_NS - read_overhead + 500) / 1000;
+    m_bitDelay = delay > 1 ? (uint32_t)delay : 1;
+
+    m_halfBitNs = (uint32_t)fastest_round_ns([this]() {
+        gpio_set_level((gpio_num_t)m_txPin, 0);
+        esp_rom_delay_us(m_halfBitDelay);
+    });
+    DALI_LOGD("Bit timing: half-bit %u ns (delay %u us, pin write %d ns), bit read delay %u us",
+        (unsigned)m_halfBitNs, (unsigned)m_halfBitDelay, (int)write_overhead, (unsigned)m_bitDelay);
+
+    m_calibrated = m_halfBitNs >= DALI_TX_HALF_BIT_MIN_NS && m_halfBitNs <= DALI_TX_HALF_BIT_MAX_NS;
+    if (!m_calibrated) {
+        DALI_LOGE("Half-bit of %u ns is outside the IEC 62386-101 limits, frames are refused", (unsigned)m_halfBitNs);
+    }
+    return m_calibrated;
+}
+
 void DaliSerialBitBangPort::writeBit(bool bit) {
     // NOTE: output is inverted - HIGH will pull the bus to 0V (logic low)
     bit = !bit;
     gpio_set_level((gpio_num_t)m_txPin, bit ? 0 : 1);
-    esp_rom_delay_us(HALF_BIT_PERIOD-6);
+    esp_rom_delay_us(m_halfBitDelay);
     gpio_set_level((gpio_num_t)m_txPin, bit ? 1 : 0);
-    esp_rom_delay_us(HALF_BIT_PERIOD-6);
+    esp_rom_delay_us(m_halfBitDelay);
 }
 
 void DaliSerialBitBangPort::writeByte(uint8_t b) {
@@ -26,12 +77,16 @@ uint8_t DaliSerialBitBangPort::readByte() {
     for (int i = 0; i < 8; i++) {
         byte <<= 1;
         byte |= gpio_get_level((gpio_num_t)m_rxPin);
-        esp_rom_delay_us(BIT_PERIOD);
+        esp_rom_delay_us(m_bitDelay);
     }
     return byte;
 }
 
 void DaliSerialBitBangPort::sendForwardFrame(uint8_t address, uint8_t data) {
+    if (!m_calibrated) {
+        DALI_LOGE("Bit timing not calibrated, frame dropped");
+        return;
+    }
     // Start bit
     writeBit(1);
     writeByte(address);
@@ -41,7 +96,25 @@ void DaliSerialBitBangPort::sendForwardFrame(uint8_t address, uint8_t data) {
     esp_rom_delay_us(BIT_PERIOD*4); // Stop bits and settling time
 }
 
+void DaliSerialBitBangPort::sendForwardFrame24(uint8_t address, uint8_t instance, uint8_t opcode) {
+    if (!m_calibrated) {
+        DALI_LOGE("Bit timing not calibrated, frame dropped");
+        return;
+    }
+    // Start bit
+    writeBit(1);
+    writeByte(address);
+    writeByte(instance);
+    writeByte(opcode);
+    // Set line to idle for stop bits
+    gpio_set_level((gpio_num_t)m_txPin, 0);
+    esp_rom_delay_us(BIT_PERIOD*4); // Stop bits and settling time
+}
+
 uint8_t DaliSerialBitBangPort::receiveBackwardFrame(unsigned long timeout_ms) {
+    if (!m_calibrated) {
+        return 0;
+    }
     int64_t startTime = esp_timer_get_time();
     
     // Wait for bus to be idle (HIGH) first
@@ -58,19 +131,19 @@ uint8_t DaliSerialBitBangPort::receiveBackwardFrame(unsigned long timeout_ms) {
         }
     }
     
-    // Now at start of start bit (LOW), wait to middle of first data bit
+    // Now at start of start bit (LOW), wait to the second half of the first data bit
     // Start bit = 1 TE low + 1 TE high = 833us total
-    // First data bit starts at 833us, middle is at 833us + 416us = 1249us
-    esp_rom_delay_us(BIT_PERIOD + HALF_BIT_PERIOD);
+    // First data bit starts at 833us, its second half at 833us + 416us = 1249us.
+    // Sample a quarter bit into that half, away from the transitions.
+    esp_rom_delay_us(BIT_PERIOD + HALF_BIT_PERIOD + QUARTER_BIT_PERIOD);
     
-    // Read 8 data bits (Manchester encoded: read at bit midpoint)
+    // Read 8 data bits
     uint8_t data = 0;
     for (int i = 0; i < 8; i++) {
         data <<= 1;
         // Manchester: bit value is the level in second half of bit period
-        // We're reading at the transition point which gives us the data value
         data |= gpio_get_level((gpio_num_t)m_rxPin) ? 1 : 0;
-        esp_rom_delay_us(BIT_PERIOD);
+        esp_rom_delay_us(m_bitDelay);
     }
     
     return data;
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// @brief Lock-free single-producer/single-consumer ring buffer
+/// @remark Exactly one task may push and exactly one task may pop, no locks are taken.
+/// The producer publishes an item with a release store of the head index, the
+/// consumer frees a slot with a release store of the tail index.
+/// @tparam N Capacity, must be a power of two
+template<typename T, size_t N>
+class DaliRing {
+    static_assert((N & (N - 1)) == 0, "DaliRing capacity must be a power of two");
+
+public:
+    /// @brief Producer side. Returns false if the ring is full.
+    /// @remark Always inlined, the RX interrupt pushes while the flash cache may be disabled.
+    __attribute__((always_inline)) bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail >= N) {
+            return false;
+        }
+        items_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Consumer side. Returns nullptr if the ring is empty.
+    /// The item stays valid until pop() is called.
+    T* peek() {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail) {
+            return nullptr;
+        }
+        return &items_[tail & (N - 1)];
+    }
+
+    /// @brief Consumer side. Returns false if the ring is empty.
+    bool pop(T& item) {
+        T* front = peek();
+        if (front == nullptr) {
+            return false;
+        }
+        item = *front;
+        pop();
+        return true;
+    }
+
+    /// @brief Consumer side. Discard the item returned by peek().
+    void pop() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    __attribute__((always_inline)) bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T items_[N];
+    std::atomic<uint32_t> head_ { 0 };
+    std::atomic<uint32_t> tail_ { 0 };
+};
@@ -1,27 +1,126 @@
 #include <esphome.h>
-#include <esp_task_wdt.h>
 #include <esp_timer.h>
+#include <new>
 #include "esphome_dali.h"
 #include "esphome_dali_light.h"
 
 //static const char *const TAG = "dali";
-static const bool DEBUG_LOG_RXTX = false; // NOTE: Will probably trigger WDT
+static const char *const TAG_MONITOR = "dali.monitor";
+
+// Monitored frames logged per loop() iteration, the rest wait in the frame ring
+static const int MONITOR_LOG_PER_LOOP = 4;
+
+// Restored levels are sent anyway if a light has not written its level by then
+static const uint32_t RESTORE_TIMEOUT_MS = 2000;
 
 using namespace esphome;
 using namespace dali;
 
-void DaliBusComponent::run_discovery() {
+void DaliBusComponent::run_discovery(bool wait) {
     if (!m_discovery) {
         DALI_LOGW("Discovery not enabled in config");
         return;
     }
-    
+    if (!is_bus_up()) {
+        // Nothing would answer, and the lights found before would be missing
+        DALI_LOGW("Bus is down, discovery skipped");
+        return;
+    }
+
+    // Only the discovery at boot assigns addresses. Run later, INITIALISE and RANDOMISE
+    // would move gear that already has a light to another short address.
+    m_discoveryMode = m_bootDiscovery ? m_initialize_addresses : DaliInitMode::DiscoverOnly;
+
+    run_progress_job("discovery",
+        [this](const DaliProgressCallback& progress) {
+            this->discover_devices(progress);
+        },
+        nullptr,
+        [this]() {
+            m_busGear = m_scanGear;
+            m_busGearComplete = m_scanComplete;
+            uint64_t before = m_discoveredLights;
+            this->create_discovered_lights();
+            this->read_identities(m_discoveredLights & ~before);
+        },
+        wait);
+}
+
+void DaliBusComponent::identify(short_addr_t short_addr) {
+    DALI_LOGI("Identifying device %.2x", short_addr);
+    dali.identifyDevice(short_addr);
+}
+
+void DaliBusComponent::save_persistent_variables(short_addr_t short_addr) {
+    DALI_LOGI("Saving persistent variables of %.2x", short_addr);
+    dali.savePersistentVariables(short_addr);
+}
+
+void DaliBusComponent::change_short_address(short_addr_t short_addr, short_addr_t new_addr) {
+    if (has_light(short_addr)) {
+        // The light would keep talking to the old address
+        DALI_LOGE("Device %.2x has a light, remove it from the config before moving the device", short_addr);
+        return;
+    }
+    auto result = std::make_shared<bool>(false);
+    run_progress_job("change_short_address",
+        [this, short_addr, new_addr, result](const DaliProgressCallback& progress) {
+            progress(0, 1);
+            *result = dali.bus_manager.changeShortAddress(short_addr, new_addr);
+            progress(1, 1);
+        },
+        nullptr,
+        [this, short_addr, new_addr, result]() {
+            if (!*result) {
+                DALI_LOGE("Could not change short address %.2x to %.2x", short_addr, new_addr);
+                return;
+            }
+            if (new_addr == 0xFF) {
+                DALI_LOGI("Cleared short address %.2x", short_addr);
+            } else {
+                DALI_LOGI("Moved device %.2x to short address %.2x", short_addr, new_addr);
+            }
+
+            // Broadcasts can no longer reach every device through a light when it lost its address
+            m_busGear &= ~(1ull << short_addr);
+            if (new_addr <= ADDR_SHORT_MAX) {
+                m_busGear |= 1ull << new_addr;
+            } else {
+                m_busGearComplete = false;
+            }
+
+            // The identity moves with the device
+            if (m_identities != nullptr && short_addr <= ADDR_SHORT_MAX && (m_identities->known & (1ull << short_addr))) {
+                m_identities->known &= ~(1ull << short_addr);
+                if (new_addr <= ADDR_SHORT_MAX) {
+                    m_identities->entries[new_addr] = m_identities->entries[short_addr];
+                    m_identities->known |= 1ull << new_addr;
+                }
+                m_identityPref.save(m_identities);
+            }
+        });
+}
+
+void DaliBusComponent::create_discovered_lights() {
+    for (uint8_t i = 0; i < m_discovered_count; i++) {
+        const DiscoveredDevice& device = m_discovered[i];
+        create_light_component(device.short_addr, device.long_addr);
+    }
+    m_discovered_count = 0;
+}
+
+void DaliBusComponent::discover_devices(const DaliProgressCallback& progress) {
+    // NOTE: Runs on the bus task, all bus I/O below is direct.
+    // Light components are created afterwards on the main loop.
+    m_discovered_count = 0;
+    m_scanGear = 0;
+    m_scanComplete = true;
+
     DALI_LOGI("Starting DALI bus discovery...");
         // Optional: reset devices on the bus so we are in a known-good state.
         // Can help if devices are not responding to anything.
         if (false) {
             this->resetBus();
-            esp_task_wdt_reset();
         }
 
         if (dali.bus_manager.isControlGearPresent()) {
@@ -30,18 +129,16 @@ void DaliBusComponent::run_discovery() {
             DALI_LOGW("No control gear detected on bus!");
         }
 
-        // for (int i = 0; i <= ADDR_SHORT_MAX; i++) {
-        //     if (m_addresses[i] != 0) {
-        //         DALI_LOGD("Static config addr: %.2x", i);
-        //     }
-        // }
+        for (uint8_t i = 0; i < m_deviceCount; i++) {
+            DALI_LOGD("Static config addr: %.2x", m_devices[i].address);
+        }
 
-        if (this->m_initialize_addresses != DaliInitMode::DiscoverOnly) {
-            if (this->m_initialize_addresses == DaliInitMode::InitializeAll) {
+        if (m_discoveryMode != DaliInitMode::DiscoverOnly) {
+            if (m_discoveryMode == DaliInitMode::InitializeAll) {
                 DALI_LOGI("Randomizing addresses for *all* DALI devices");
                 dali.bus_manager.initialize(ASSIGN_ALL); 
             } 
-            else if (this->m_initialize_addresses == DaliInitMode::InitializeUnassigned) {
+            else if (m_discoveryMode == DaliInitMode::InitializeUnassigned) {
                 // Only randomize devices without an assigned short address
                 DALI_LOGI("Randomizing addresses for unassigned DALI devices");
                 dali.bus_manager.initialize(ASSIGN_UNINITIALIZED); 
@@ -59,28 +156,33 @@ void DaliBusComponent::run_discovery() {
         uint8_t count = 0;
         
         // For DiscoverOnly mode with pre-configured devices, poll short addresses
-        if (this->m_initialize_addresses == DaliInitMode::DiscoverOnly) {
+        if (m_discoveryMode == DaliInitMode::DiscoverOnly) {
             DALI_LOGI("Polling short addresses 0-63...");
             
             for (short_addr_t addr = 0; addr <= ADDR_SHORT_MAX; addr++) {
-                vTaskDelay(pdMS_TO_TICKS(1)); // yield to ESP stack
-                esp_task_wdt_reset();
-                
+                progress(addr, ADDR_SHORT_MAX + 1);
                 if (dali.isDevicePresent(addr)) {
                     DALI_LOGI("  Found device @ %.2x", addr);
+                    m_scanGear |= 1ull << addr;
                     
                     // Dynamic component creation (if not defined in YAML)
-                    if (m_addresses[addr]) {
+                    if (has_light(addr)) {
                         DALI_LOGD("  Ignoring, already defined");
                     }
                     else {
-                        m_addresses[addr] = 0; // No long address for pre-configured devices
-                        create_light_component(addr, 0);
+                        // No long address for pre-configured devices
+                        m_discovered[m_discovered_count++] = DiscoveredDevice { addr, 0 };
                         count++;
                     }
                 }
             }
             
+            progress(ADDR_SHORT_MAX + 1, ADDR_SHORT_MAX + 1);
+            // Polling only finds gear with a short address
+            if (dali.bus_manager.isMissingShortAddress()) {
+                DALI_LOGW("Found devices without a short address");
+                m_scanComplete = false;
+            }
             DALI_LOGI("Discovery complete, found %d device(s)", count);
             return;
         }
@@ -99,8 +201,8 @@ void DaliBusComponent::run_discovery() {
         uint32_t long_addr = 0;
         while (dali.bus_manager.findNextAddress(short_addr, long_addr)) {
             count++;
-            vTaskDelay(pdMS_TO_TICKS(1)); // yield to ESP stack
-            esp_task_wdt_reset();
+            // Number of devices is unknown until the scan ends
+            progress(count, 0);
 
             // if (short_addr == 0xFF) {
             //     if (this->m_initialize_addresses) {
@@ -142,7 +244,7 @@ void DaliBusComponent::run_discovery() {
 
                 // Duplicate detection
                 if (is_discovered[short_addr]) {
-                    if (m_initialize_addresses == DaliInitMode::DiscoverOnly) {
+                    if (m_discoveryMode == DaliInitMode::DiscoverOnly) {
                         DALI_LOGW("  WARNING: Duplicate short address detected!");
                         duplicate_detected = true;
                         // TODO: Maybe don't register the component in this case?
@@ -156,6 +258,7 @@ void DaliBusComponent::run_discovery() {
                         if (!dali.bus_manager.programShortAddress(short_addr)) {
                             DALI_LOGE("  Could not program short address");
                             short_addr = 0xFF;
+                            m_scanComplete = false;
                             continue;
                         }
                     }
@@ -163,22 +266,23 @@ void DaliBusComponent::run_discovery() {
                 else {
                     is_discovered[short_addr] = true;
                 }
+                m_scanGear |= 1ull << short_addr;
 
                 // Dynamic component creation (if not defined in YAML)
-                if (m_addresses[short_addr]) {
+                if (has_light(short_addr)) {
                     DALI_LOGD("  Ignoring, already defined");
                 }
-                else {
-                    m_addresses[short_addr] = long_addr;
-                    create_light_component(short_addr, long_addr);
+                else if (m_discovered_count <= ADDR_SHORT_MAX) {
+                    m_discovered[m_discovered_count++] = DiscoveredDevice { short_addr, long_addr };
                 }
             }
             else if (short_addr == 0xFF) {
-                if (m_initialize_addresses == DaliInitMode::DiscoverOnly) {
+                if (m_discoveryMode == DaliInitMode::DiscoverOnly) {
                     DALI_LOGI("  Device %.6x @ --", long_addr);
                     // You'll need to assign a short address before the device will respond to commands.
                     // However it will still respond to BROADCAST brightness updates...
                     DALI_LOGW("  No short address assigned!");
+                    m_scanComplete = false;
                     continue;
                 }
                 else {
@@ -188,10 +292,12 @@ void DaliBusComponent::run_discovery() {
                     if (!dali.bus_manager.programShortAddress(short_addr)) {
                         DALI_LOGE("  Could not program short address");
                         short_addr = 0xFF;
+                        m_scanComplete = false;
                         continue;
                     }
 
                     DALI_LOGI("  Device %.6x @ %.2x", long_addr, short_addr);
+                    m_scanGear |= 1ull << short_addr;
                 }
             }
         }
@@ -200,25 +306,101 @@ void DaliBusComponent::run_discovery() {
         dali.bus_manager.endAddressScan();
 
         if (duplicate_detected) {
+            m_scanComplete = false;
             DALI_LOGW("Duplicate short addresses detected on the bus!");
             DALI_LOGW("  Devices may report inconsistent capabilities.");
             DALI_LOGW("  You should fix your address assignments!");
         }
 }
 
+void DaliBusComponent::read_identities(uint64_t devices) {
+    if (m_identities == nullptr || devices == 0) {
+        return;
+    }
+
+    DaliJob* job = new DaliJob;
+    job->run = [this, devices]() { this->query_identities(devices); };
+    job->done = [this]() {
+        if (m_identitiesChanged) {
+            m_identityPref.save(m_identities);
+            m_identitiesChanged = false;
+        }
+    };
+    run_job(job);
+}
+
+void DaliBusComponent::query_identities(uint64_t devices) {
+    uint8_t cached = 0;
+    uint8_t read = 0;
+    for (short_addr_t addr = 0; addr <= ADDR_SHORT_MAX; addr++) {
+        uint64_t bit = 1ull << addr;
+        if (!(devices & bit)) {
+            continue;
+        }
+        DaliIdentity& entry = m_identities->entries[addr];
+
+        // A cached identity costs 4 frames to confirm, a full read of bank 0 about 22
+        if ((m_identities->known & bit) &&
+            dali.memory.readSerialTail(addr, entry.serial_bytes) == (uint16_t)entry.serial) {
+            cached++;
+            continue;
+        }
+
+        DaliIdentity identity;
+        if (!dali.memory.readIdentity(addr, identity)) {
+            if (m_identities->known & bit) {
+                m_identities->known &= ~bit;
+                m_identitiesChanged = true;
+            }
+            continue;
+        }
+        read++;
+
+        // Re-addressed gear: forget the old address of this serial number
+        for (short_addr_t other = 0; other <= ADDR_SHORT_MAX; other++) {
+            if ((m_identities->known & (1ull << other)) && m_identities->entries[other].serial == identity.serial) {
+                m_identities->known &= ~(1ull << other);
+            }
+        }
+        entry = identity;
+        m_identities->known |= bit;
+        m_identitiesChanged = true;
+
+        DALI_LOGI("  Device @ %.2x: GTIN %llu serial %llx firmware %d.%d", addr,
+            (unsigned long long)identity.gtin, (unsigned long long)identity.serial,
+            identity.firmware_major, identity.firmware_minor);
+    }
+    DALI_LOGD("Identities: %d cached, %d read from bank 0", cached, read);
+}
+
 void DaliBusComponent::create_light_component(short_addr_t short_addr, uint32_t long_addr) {
 #ifdef USE_LIGHT
-    DaliLight* dali_light = new DaliLight { this };
-    dali_light->set_address(short_addr);
+    if (m_lightPoolUsed >= m_lightPoolSize) {
+        DALI_LOGE("No room for light %.2x, raise max_discovered_lights", short_addr);
+        return;
+    }
 
-    const int MAX_STR_LEN = 20;
-    char* name = new char[MAX_STR_LEN];
-    char* id = new char[MAX_STR_LEN];
-    snprintf(name, MAX_STR_LEN, "DALI Light %d", short_addr);
-    snprintf(id, MAX_STR_LEN, "dali_light_%.6x", long_addr);
-    // NOTE: Not freeing these strings, they will be owned by LightState.
+    // Lights live as long as the application, so they are never destroyed
+    DaliLightSlot& slot = m_lightPool[m_lightPoolUsed++];
+    slot.config = DaliDeviceConfig { short_addr, 0, 0, 0, 0, 0, 0, DaliLedDimmingCurve::LOGARITHMIC, 0 };
+    DaliLight* dali_light = new (slot.light) DaliLight { this };
+    dali_light->set_config(&slot.config);
+    m_discoveredLights |= 1ull << short_addr;
 
-    auto* light_state = new light::LightState { dali_light };
+    char* name = slot.name;
+    char* id = slot.object_id;
+    snprintf(name, sizeof(slot.name), "DALI Light %d", short_addr);
+    // The serial number stays the same when the gear is re-addressed, so Home Assistant keeps the entity.
+    // The random long address changes on every randomize and is 0 for gear found by polling.
+    if (m_identities != nullptr && (m_identities->known & (1ull << short_addr))) {
+        snprintf(id, sizeof(slot.object_id), "dali_light_%llx", (unsigned long long)m_identities->entries[short_addr].serial);
+    } else if (long_addr != 0) {
+        snprintf(id, sizeof(slot.object_id), "dali_light_%.6x", (unsigned)long_addr);
+    } else {
+        snprintf(id, sizeof(slot.object_id), "dali_light_%.2x", short_addr);
+    }
+
+    auto* light_state = new (slot.state) light::LightState { dali_light };
     light_state->set_component_source(LOG_STR("light"));
     App.register_light(light_state);
     App.register_component(light_state);
@@ -226,7 +408,13 @@ void DaliBusComponent::create_light_component(short_addr_t short_addr, uint32_t
     light_state->set_object_id(id);
     light_state->set_disabled_by_default(false);
     // NOTE: restore_mode is set by YAML config, not hardcoded here
-    light_state->add_effects({});
+    // DALI effects with their defaults, the gear animates them itself
+    light_state->add_effects({
+        new (slot.pulse) DaliPulseEffect { "DALI Pulse" },
+        new (slot.breathe) DaliBreatheEffect { "DALI Breathe" },
+        new (slot.wake_up) DaliWakeUpEffect { "DALI Wake-up" },
+        new (slot.identify) DaliIdentifyEffect { "DALI Identify" },
+    });
 
     DALI_LOGI("Created light component '%s' (%s)", name, id);
 #else
@@ -235,115 +423,776 @@ void DaliBusComponent::create_light_component(short_addr_t short_addr, uint32_t
 #endif
 }
 
+bool DaliBusComponent::has_light(short_addr_t short_addr) const {
+    if (m_discoveredLights & (1ull << short_addr)) {
+        return true;
+    }
+    for (uint8_t i = 0; i < m_deviceCount; i++) {
+        if (m_devices[i].address == short_addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void DaliBusComponent::setup() {
+    m_scheduler = &DaliBusScheduler::instance();
     m_txPin->pin_mode(gpio::Flags::FLAG_OUTPUT);
     m_rxPin->pin_mode(gpio::Flags::FLAG_INPUT);
+
+    if (m_monitor || m_inputEvents) {
+        m_monitorEdges = new DaliRing<DaliEdge, DALI_MONITOR_EDGE_RING>;
+        m_monitorFrames = new DaliRing<DaliFrameRecord, DALI_MONITOR_FRAME_RING>;
+        m_rxIsr = m_rxPin->to_isr();
+        m_rxPin->attach_interrupt(DaliBusComponent::rx_edge_isr, this, gpio::INTERRUPT_ANY_EDGE);
+    }
+    m_scheduler->register_bus(this);
+
+    // Queued before any frame
+    DaliJob* calibration = new DaliJob;
+    calibration->run = [this]() { DaliBusScheduler::instance().calibrate(this); };
+    calibration->done = [this]() { this->report_timing(); };
+    run_job(calibration);
+
+    // LightState::setup() only schedules the restored level, the lights write it from their
+    // first loop(). restore_level() flushes once every light announced by expect_restore() did.
+    m_restoreSince = millis();
+
+    // First health sweep right after boot, then once per interval
+    m_healthSweepStart = millis() - m_healthInterval;
     DALI_LOGI("DALI bus ready");
 
     if (m_discovery) {
-        run_discovery();
+        m_identities = new IdentityCache;
+        // One cache per bus, keyed by its TX pin
+        char pin[32];
+        m_txPin->dump_summary(pin, sizeof(pin));
+        m_identityPref = global_preferences->make_preference<IdentityCache>(fnv1_hash(std::string("dali_identity_") + pin));
+        if (!m_identityPref.load(m_identities)) {
+            m_identities->known = 0;
+        }
+
+        // Lights must exist before setup() moves on to the light components
+        run_discovery(true);
     }
+    m_bootDiscovery = false;
 }
 
 void DaliBusComponent::loop() {
+    DaliCompletion completion;
+    while (m_completions.pop(completion)) {
+        process_completion(completion);
+    }
+
+    if (m_monitorFrames != nullptr) {
+        DaliFrameRecord frame;
+        for (int i = 0; i < MONITOR_LOG_PER_LOOP && m_monitorFrames->pop(frame); i++) {
+            if (frame.source == DaliFrameSource::BUS && frame.bits == 24 && !frame.error && DALI_EVENT_IS_EVENT(frame.data)) {
+                m_inputEventCallback.call(frame.data);
+            }
+            if (m_monitor) {
+                log_frame(frame);
+                m_frameCallback.call(frame);
+            }
+        }
+
+        uint32_t dropped = m_monitorDropped.load(std::memory_order_relaxed);
+        if (dropped != m_monitorDroppedReported) {
+            ESP_LOGW(TAG_MONITOR, "%u frames dropped, logger can not keep up", (unsigned)(dropped - m_monitorDroppedReported));
+            m_monitorDroppedReported = dropped;
+        }
+    }
+
+    if (!m_progressJobs.empty()) {
+        report_progress(*m_progressJobs.front());
+    }
+
+    if (m_restoring && millis() - m_restoreSince >= RESTORE_TIMEOUT_MS) {
+        DALI_LOGW("%d light(s) did not restore their level, sending the restored levels", m_restorePending);
+        flush_restore();
+    }
+    process_bus_state();
+    if (!m_loopbackReported) {
+        report_loopback();
+    }
+    process_verify();
+    process_health();
+
+    uint32_t collisions = m_collisions.load(std::memory_order_relaxed);
+    uint32_t lost = m_lostFrames.load(std::memory_order_relaxed);
+    if (collisions != m_collisionsReported || lost != m_lostFramesReported) {
+        ESP_LOGW(TAG_DALI, "Bus collisions: %u, frames lost: %u", (unsigned)collisions, (unsigned)lost);
+        m_collisionsReported = collisions;
+        m_lostFramesReported = lost;
+    }
+}
+
+void DaliBusComponent::configure(DaliConfigBatch batch, DaliProgressCallback&& progress) {
+    // Runs as one job so nothing else can touch DTR0 between a write and the commands using it
+    run_progress_job("configure",
+        [this, batch](const DaliProgressCallback& progress) { dali.configure(batch, progress); },
+        std::move(progress));
+}
+
+void DaliBusComponent::run_progress_job(const char* operation, std::function<void(const DaliProgressCallback&)>&& run,
+        DaliProgressCallback&& progress, std::function<void()>&& done, bool wait) {
+    auto state = std::make_shared<ProgressJob>();
+    state->operation = operation;
+    state->callback = std::move(progress);
+    m_progressJobs.push_back(state);
+
+    DaliJob* job = new DaliJob;
+    job->run = [state, run = std::move(run)]() {
+        run([state](size_t done, size_t total) {
+            state->progress.store(((uint32_t)done << 16) | (total & 0xFFFF), std::memory_order_relaxed);
+        });
+    };
+    job->done = [this, state, done = std::move(done)]() {
+        report_progress(*state);
+        m_progressJobs.pop_front();
+        if (done) {
+            done();
+        }
+    };
+    run_job(job, wait);
+}
+
+void DaliBusComponent::report_progress(ProgressJob& job) {
+    uint32_t progress = job.progress.load(std::memory_order_relaxed);
+    if (progress == job.reported) {
+        return;
+    }
+    job.reported = progress;
+    if (job.callback) {
+        job.callback(progress >> 16, progress & 0xFFFF);
+    }
+    m_progressCallback.call(job.operation, progress >> 16, progress & 0xFFFF);
+}
+
+void DaliBusComponent::expect_restore() {
+    if (m_restoring) {
+        m_restorePending++;
+    }
+}
+
+bool DaliBusComponent::restore_level(short_addr_t short_addr, uint8_t level) {
+    if (!m_restoring || short_addr > ADDR_SHORT_MAX) {
+        return false;
+    }
+    bool first = !(m_restoreMask & (1ull << short_addr));
+    m_restoreLevels[short_addr] = level;
+    m_restoreMask |= 1ull << short_addr;
+
+    // The last light to restore sends the levels of all of them
+    if (first && m_restorePending > 0 && --m_restorePending == 0) {
+        flush_restore();
+    }
+    return true;
+}
+
+void DaliBusComponent::flush_restore() {
+    if (!m_restoring) {
+        return;
+    }
+    m_restoring = false;
+    m_restorePending = 0;
+    if (m_restoreMask != 0) {
+        send_restore();
+    }
+
+    // Queued behind the restored levels and ahead of the state sync of the lights,
+    // which then reads min/max from RAM
+    warm_attributes();
+}
+
+void DaliBusComponent::send_restore() {
+    // Most common restored level
+    uint8_t counts[256] = {0};
+    int common = 0;
+    for (short_addr_t addr = 0; addr <= ADDR_SHORT_MAX; addr++) {
+        if (m_restoreMask & (1ull << addr)) {
+            uint8_t level = m_restoreLevels[addr];
+            if (++counts[level] > counts[common]) {
+                common = level;
+            }
+        }
+    }
+
+    uint64_t remaining = m_restoreMask;
+    int frames = 0;
+    if (counts[common] >= 2) {
+        uint64_t members = 0;
+        for (short_addr_t addr = 0; addr <= ADDR_SHORT_MAX; addr++) {
+            if ((m_restoreMask & (1ull << addr)) && m_restoreLevels[addr] == common) {
+                members |= 1ull << addr;
+            }
+        }
+
+        if (m_busGearComplete && (m_busGear & ~members) == 0) {
+            // Discovery saw every device on the bus and all of them restore to this level
+            dali.lamp.setBrightness(ADDR_BROADCAST, common);
+            frames++;
+            remaining &= ~members;
+        }
+        else {
+            // Other devices may be on the bus, only use groups the device table defines
+            uint64_t groups[16] = {0};
+            for (uint8_t i = 0; i < m_deviceCount; i++) {
+                const DaliDeviceConfig& device = m_devices[i];
+                if (device.address > ADDR_SHORT_MAX || !device.has(DALI_CONFIG_GROUPS)) {
+                    continue;
+                }
+                for (uint8_t group = 0; group < 16; group++) {
+                    if (device.groups & (1 << group)) {
+                        groups[group] |= 1ull << device.address;
+                    }
+                }
+            }
+
+            for (;;) {
+                // Largest group whose members all restore to this level
+                int best = -1;
+                int best_count = 1;
+                for (int group = 0; group < 16; group++) {
+                    if (groups[group] == 0 || (groups[group] & ~members) != 0) {
+                        continue;
+                    }
+                    int count = __builtin_popcountll(groups[group] & remaining);
+                    if (count > best_count) {
+                        best = group;
+                        best_count = count;
+                    }
+                }
+                if (best < 0) {
+                    break;
+                }
+                dali.lamp.setBrightness(ADDR_GROUP | best, common);
+                frames++;
+                remaining &= ~groups[best];
+            }
+        }
+    }
+
+    // Exceptions
+    for (short_addr_t addr = 0; remaining != 0; addr++, remaining >>= 1) {
+        if (remaining & 1) {
+            dali.lamp.setBrightness(addr, m_restoreLevels[addr]);
+            frames++;
+        }
+    }
+
+    DALI_LOGI("Restored %d lights with %d frames", __builtin_popcountll(m_restoreMask), frames);
+}
+
+void DaliBusComponent::warm_attributes() {
+    uint64_t devices = m_discoveredLights;
+    for (uint8_t i = 0; i < m_deviceCount; i++) {
+        if (m_devices[i].address <= ADDR_SHORT_MAX) {
+            devices |= 1ull << m_devices[i].address;
+        }
+    }
+    if (devices == 0) {
+        return;
+    }
+
+    DaliJob* job = new DaliJob;
+    job->run = [this, devices]() {
+        uint8_t answered = dali.warmAttributes(devices);
+        DALI_LOGD("Attribute cache warmed for %d of %d devices", answered, __builtin_popcountll(devices));
+    };
+    run_job(job);
+}
+
+void DaliBusComponent::verify_level(short_addr_t short_addr, uint8_t level, uint8_t expected, uint32_t delay_ms) {
+    if (short_addr > ADDR_SHORT_MAX) {
+        return;
+    }
+
+    m_verifyCancelled &= ~(1ull << short_addr);
+    uint32_t due = millis() + delay_ms;
+    for (PendingVerify& pending : m_verify) {
+        if (pending.short_addr == short_addr) {
+            pending = PendingVerify { short_addr, level, expected, 0, delay_ms, due };
+            return;
+        }
+    }
+    m_verify.push_back(PendingVerify { short_addr, level, expected, 0, delay_ms, due });
+}
 
+void DaliBusComponent::cancel_verify(short_addr_t short_addr) {
+    if (short_addr > ADDR_SHORT_MAX) {
+        return;
+    }
+    for (size_t i = 0; i < m_verify.size(); i++) {
+        if (m_verify[i].short_addr == short_addr) {
+            m_verify.erase(m_verify.begin() + i);
+            break;
+        }
+    }
+    // A check already on the bus must not resend the old level either
+    m_verifyCancelled |= 1ull << short_addr;
+}
+
+void DaliBusComponent::process_bus_state() {
+    bool down = m_busDown.load(std::memory_order_acquire);
+    if (down == m_busDownReported) {
+        return;
+    }
+    m_busDownReported = down;
+
+    if (down) {
+        DALI_LOGE("Bus down: line held active, no bus power or a short circuit");
+        // The levels are resent once the bus is back, checking them now would only log mismatches
+        m_verify.clear();
+        m_busStateCallback.call(false);
+        return;
+    }
+
+    DALI_LOGI("Bus is back, resending light levels");
+    // Same plan as after boot: lights hand their current level to restore_level()
+    m_restoring = true;
+    m_restoreMask = 0;
+    m_busStateCallback.call(true);
+    m_restoring = false;
+    if (m_restoreMask != 0) {
+        send_restore();
+    }
+
+    // Queries failed while the bus was down, and the gear may have been power cycled with it
+    DaliJob* job = new DaliJob;
+    job->run = [this]() { dali.attributes.clear(); };
+    run_job(job);
+    warm_attributes();
+}
+
+void DaliBusComponent::report_timing() {
+    DALI_LOGD("Bit timing: half-bit %d..%d us", m_timing.half_bit_min_us, m_timing.half_bit_max_us);
+    if (m_timing.half_bit_min_us * 1000u < DALI_TX_HALF_BIT_MIN_NS || m_timing.half_bit_max_us * 1000u > DALI_TX_HALF_BIT_MAX_NS) {
+        DALI_LOGE("Half-bits of %d..%d us are outside the IEC 62386-101 transmitter limits, gear may not understand this bus",
+            m_timing.half_bit_min_us, m_timing.half_bit_max_us);
+        this->status_set_warning("DALI bit timing out of spec");
+    }
+}
+
+void DaliBusComponent::report_loopback() {
+    uint32_t loopback = m_loopback.load(std::memory_order_relaxed);
+    if (loopback == 0) {
+        return;
+    }
+    m_loopbackReported = true;
+
+    // An active half-bit as RX sees it
+    unsigned active = loopback >> 16;
+    unsigned idle = loopback & 0xFFFF;
+    int32_t half_bit_ns = DALI_HALF_BIT_NS + ((int32_t)idle - (int32_t)active) * 1000;
+    DALI_LOGD("RX loopback: active after %u us, idle after %u us, replies sampled at %d us",
+        active, idle, (int)DaliBusScheduler::sample_offset_us(this));
+    if (half_bit_ns < DALI_RX_HALF_BIT_MIN_NS || half_bit_ns > DALI_RX_HALF_BIT_MAX_NS) {
+        DALI_LOGW("RX stretches half-bits to %d us, outside the IEC 62386-101 receiver limits. Check the RX circuit",
+            (int)(half_bit_ns / 1000));
+    }
+}
+
+void DaliBusComponent::process_verify() {
+    // Commands always go first, verification only fills the gaps
+    if (m_verifyInFlight || m_verify.empty() || !m_commands.empty() || !is_bus_up()) {
+        return;
+    }
+
+    uint32_t now = millis();
+    for (size_t i = 0; i < m_verify.size(); i++) {
+        if ((int32_t)(now - m_verify[i].due_ms) < 0) {
+            continue;
+        }
+
+        PendingVerify check = m_verify[i];
+        m_verify.erase(m_verify.begin() + i);
+        m_verifyInFlight = true;
+
+        dali.queryAsync(check.short_addr, DaliCommand::QUERY_ACTUAL_LEVEL, [this, check](uint8_t actual) {
+            m_verifyInFlight = false;
+
+            if (!is_bus_up()) {
+                // No reply from a dead bus, the level is resent when it is back
+                return;
+            }
+
+            if (m_verifyCancelled & (1ull << check.short_addr)) {
+                m_verifyCancelled &= ~(1ull << check.short_addr);
+                return;
+            }
+            for (const PendingVerify& pending : m_verify) {
+                if (pending.short_addr == check.short_addr) {
+                    // Written again meanwhile, the newer write gets its own check
+                    return;
+                }
+            }
+
+            if (actual == check.expected) {
+                ESP_LOGV(TAG_DALI, "DALI[%.2x] Verified level %d", check.short_addr, actual);
+                return;
+            }
+
+            if (check.attempts >= DALI_VERIFY_RETRIES) {
+                ESP_LOGE(TAG_DALI, "DALI[%.2x] Level %d not applied after %d retries (reports %d)",
+                    check.short_addr, check.expected, DALI_VERIFY_RETRIES, actual);
+                return;
+            }
+
+            ESP_LOGW(TAG_DALI, "DALI[%.2x] Level mismatch, expected %d, reports %d. Resending",
+                check.short_addr, check.expected, actual);
+            dali.lamp.setBrightness(check.short_addr, check.level);
+
+            PendingVerify retry = check;
+            retry.attempts++;
+            retry.due_ms = millis() + check.delay_ms;
+            m_verify.push_back(retry);
+        });
+        return;
+    }
+}
+
+void DaliBusComponent::add_health_address(short_addr_t short_addr) {
+    for (short_addr_t address : m_healthAddresses) {
+        if (address == short_addr) {
+            return;
+        }
+    }
+    m_healthAddresses.push_back(short_addr);
+}
+
+void DaliBusComponent::process_health() {
+    if (m_healthAddresses.empty() || m_healthInFlight) {
+        return;
+    }
+
+    if (!m_healthSweeping) {
+        if (millis() - m_healthSweepStart < m_healthInterval) {
+            return;
+        }
+        m_healthSweepStart = millis();
+        m_healthIndex = 0;
+        m_healthSweeping = true;
+    }
+
+    // Like verification, only use idle bus time. A dead bus would report every device healthy.
+    if (!m_commands.empty() || !is_bus_up()) {
+        return;
+    }
+
+    if (m_healthIndex >= m_healthAddresses.size()) {
+        m_healthSweeping = false;
+        return;
+    }
+
+    short_addr_t short_addr = m_healthAddresses[m_healthIndex++];
+    m_healthInFlight = true;
+    query_async(short_addr, DaliCommand::QUERY_STATUS, [this, short_addr](optional<uint8_t> reply) {
+        if (!is_bus_up()) {
+            m_healthInFlight = false;
+            return;
+        }
+        if (!reply.has_value()) {
+            // Gear that vanished from the bus is a failure, not a clean status
+            m_healthInFlight = false;
+            ESP_LOGW(TAG_DALI, "DALI[%.2x] No reply to the health check", short_addr);
+            m_healthCallback.call(short_addr, STATUS_GEAR_FAILURE, 0);
+            return;
+        }
+
+        uint8_t status = *reply;
+        if ((status & (STATUS_GEAR_FAILURE | STATUS_LAMP_FAILURE)) == 0) {
+            m_healthInFlight = false;
+            m_healthCallback.call(short_addr, status, 0);
+            return;
+        }
+
+        // Something failed, find out what
+        dali.led.getFailureStatusAsync(short_addr, [this, short_addr, status](uint8_t failure) {
+            m_healthInFlight = false;
+            ESP_LOGW(TAG_DALI, "DALI[%.2x] Failure reported, status: %02x, LED failure status: %02x", short_addr, status, failure);
+            m_healthCallback.call(short_addr, status, failure);
+        });
+    });
+}
+
+void IRAM_ATTR DaliBusComponent::rx_edge_isr(DaliBusComponent* bus) {
+    if (bus->m_monitorPaused.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    DaliEdge edge { (uint32_t)esp_timer_get_time(), bus->m_rxIsr.digital_read() };
+    bool was_empty = bus->m_monitorEdges->empty();
+    if (!bus->m_monitorEdges->push(edge)) {
+        bus->m_monitorDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (was_empty) {
+        // First edge of a frame, the bus task polls until it ends
+        bus->m_scheduler->notify_from_isr();
+    }
+}
+
+void DaliBusComponent::log_frame(const DaliFrameRecord& frame) {
+    static const char* const SOURCES[] = { "BUS", "TX ", "RX " };
+    const char* source = SOURCES[(uint8_t)frame.source];
+    unsigned seconds = frame.time_us / 1000000;
+    unsigned micros = frame.time_us % 1000000;
+    unsigned data = frame.data;
+
+    if (frame.error) {
+        ESP_LOGW(TAG_MONITOR, "[%u.%06u] %s invalid frame (%d bits: %06x)", seconds, micros, source, frame.bits, data);
+    } else if (frame.bits == 24) {
+        ESP_LOGD(TAG_MONITOR, "[%u.%06u] %s %02x %02x %02x", seconds, micros, source,
+            (data >> 16) & 0xFF, (data >> 8) & 0xFF, data & 0xFF);
+    } else if (frame.bits == 16) {
+        ESP_LOGD(TAG_MONITOR, "[%u.%06u] %s %02x %02x", seconds, micros, source, (data >> 8) & 0xFF, data & 0xFF);
+    } else if (frame.bits == 8) {
+        ESP_LOGD(TAG_MONITOR, "[%u.%06u] %s       %02x", seconds, micros, source, data & 0xFF);
+    } else {
+        ESP_LOGD(TAG_MONITOR, "[%u.%06u] %s       -- (no reply)", seconds, micros, source);
+    }
 }
 
 void DaliBusComponent::dump_config() {
+    ESP_LOGCONFIG(TAG_DALI, "DALI Bus:");
+    LOG_PIN("  TX Pin: ", m_txPin);
+    LOG_PIN("  RX Pin: ", m_rxPin);
+    ESP_LOGCONFIG(TAG_DALI, "  Buses sharing bus task: %d (core %d)", (int)DaliBusScheduler::instance().bus_count(), DALI_TASK_CORE);
+    ESP_LOGCONFIG(TAG_DALI, "  Monitor: %s", YESNO(m_monitor));
+    ESP_LOGCONFIG(TAG_DALI, "  Bus: %s", is_bus_up() ? "up" : "DOWN");
+    if (m_timing.half_bit_max_us != 0) {
+        ESP_LOGCONFIG(TAG_DALI, "  Half-bit: %d..%d us", m_timing.half_bit_min_us, m_timing.half_bit_max_us);
+    }
+    uint32_t loopback = m_loopback.load(std::memory_order_relaxed);
+    if (loopback != 0) {
+        ESP_LOGCONFIG(TAG_DALI, "  RX loopback: %u us active, %u us idle, replies sampled at %d us",
+            (unsigned)(loopback >> 16), (unsigned)(loopback & 0xFFFF), (int)DaliBusScheduler::sample_offset_us(this));
+    }
+    if (!m_healthAddresses.empty()) {
+        ESP_LOGCONFIG(TAG_DALI, "  Health check: %d devices every %us", (int)m_healthAddresses.size(), (unsigned)(m_healthInterval / 1000));
+    }
+    ESP_LOGCONFIG(TAG_DALI, "  Collisions: %u, frames lost: %u",
+        (unsigned)m_collisions.load(std::memory_order_relaxed), (unsigned)m_lostFrames.load(std::memory_order_relaxed));
+}
 
+bool DaliBusComponent::is_direct() const {
+    DaliBusScheduler& scheduler = DaliBusScheduler::instance();
+    return !scheduler.is_running() || scheduler.in_bus_task();
 }
 
-#define QUARTER_BIT_PERIOD 208
-#define HALF_BIT_PERIOD 416
-#define BIT_PERIOD 833
+uint32_t DaliBusComponent::next_tag() {
+    if (++m_next_tag == 0) {
+        m_next_tag = 1;
+    }
+    return m_next_tag;
+}
 
-void DaliBusComponent::writeBit(bool bit) {
-    // NOTE: output is inverted - HIGH will pull the bus to 0V (logic low)
-    bit = !bit;
-    m_txPin->digital_write(!bit);
-    esp_rom_delay_us(HALF_BIT_PERIOD-6);
-    m_txPin->digital_write(bit);
-    esp_rom_delay_us(HALF_BIT_PERIOD-6);
+uint32_t DaliBusComponent::submit(DaliTransaction transaction) {
+    DaliBusScheduler& scheduler = DaliBusScheduler::instance();
+    while (!m_commands.push(transaction)) {
+        // Ring full, let the bus task catch up. It may itself wait for room in the completion
+        // ring, so drain that here or both tasks would wait for each other.
+        DaliCompletion completion;
+        while (m_completions.pop(completion)) {
+            process_completion(completion);
+        }
+        scheduler.notify();
+        vTaskDelay(1);
+    }
+    scheduler.notify();
+    return transaction.tag;
+}
+
+uint8_t DaliBusComponent::wait_for(uint32_t tag) {
+    // Completions are also handled by submit() and nested waits, so the result is recorded
+    // in the waiter wherever its completion is processed
+    Waiter waiter { tag, false, 0, m_waitChain };
+    m_waitChain = &waiter;
+    // An async callback may itself block on a query, so restore the outer waiter afterwards
+    TaskHandle_t previous = m_waiter.exchange(xTaskGetCurrentTaskHandle(), std::memory_order_acq_rel);
+    for (;;) {
+        DaliCompletion completion;
+        while (!waiter.done && m_completions.pop(completion)) {
+            process_completion(completion);
+        }
+        if (waiter.done) {
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+        App.feed_wdt();
+    }
+    m_waiter.store(previous, std::memory_order_release);
+    m_waitChain = waiter.outer;
+    return waiter.reply;
 }
 
-void DaliBusComponent::writeByte(uint8_t b) {
-    for (int i = 0; i < 8; i++) {
-        writeBit(b & 0x80);
-        b <<= 1;
+void DaliBusComponent::process_completion(const DaliCompletion& completion) {
+    for (Waiter* waiter = m_waitChain; waiter != nullptr; waiter = waiter->outer) {
+        if (waiter->tag == completion.tag) {
+            waiter->done = true;
+            waiter->reply = completion.reply;
+        }
+    }
+    if (!m_pending_queries.empty() && m_pending_queries.front().tag == completion.tag) {
+        auto callback = std::move(m_pending_queries.front().callback);
+        m_pending_queries.pop_front();
+        if (completion.received) {
+            callback(completion.reply);
+        } else {
+            callback({});
+        }
+    }
+    if (completion.job != nullptr) {
+        if (completion.job->done) {
+            completion.job->done();
+        }
+        delete completion.job;
     }
 }
 
-uint8_t DaliBusComponent::readByte() {
-    uint8_t byte = 0;
-    for (int i = 0; i < 8; i++) {
-        byte <<= 1;
-        byte |= m_rxPin->digital_read();
-        esp_rom_delay_us(BIT_PERIOD);
+void DaliBusComponent::run_job(DaliJob* job, bool wait) {
+    if (is_direct()) {
+        job->run();
+        if (job->done) {
+            job->done();
+        }
+        delete job;
+        return;
+    }
+
+    uint32_t tag = submit(DaliTransaction { DaliTransactionType::JOB, 0, 0, 0, wait ? next_tag() : 0, job });
+    if (wait) {
+        wait_for(tag);
     }
-    return byte;
 }
 
 void DaliBusComponent::resetBus() {
-    DALI_LOGD("Resetting bus");
-    m_txPin->digital_write(true);
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    m_txPin->digital_write(false);
+    DaliJob* job = new DaliJob;
+    job->run = [this]() {
+        DALI_LOGD("Resetting bus");
+        m_txPin->digital_write(true);
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        m_txPin->digital_write(false);
+    };
+    run_job(job, true);
 }
 
 void DaliBusComponent::sendForwardFrame(uint8_t address, uint8_t data) {
-    if (DEBUG_LOG_RXTX) {
-        DALI_LOGD("TX: %02x %02x", address, data);
-        delayMicroseconds(BIT_PERIOD*8);
-        //Serial.print("TX: "); Serial.print(address, HEX); Serial.print(" "); Serial.println(data, HEX);
+    if (is_direct()) {
+        DaliBusScheduler::instance().transmit(this, ((uint32_t)address << 8) | data);
+        return;
     }
 
-    {
-        // This is timing critical
-        InterruptLock lock;
+    // No reply expected, the caller does not need to wait
+    submit(DaliTransaction { DaliTransactionType::FORWARD, address, data, 0, 0, nullptr });
+}
 
-        writeBit(1); // START bit
-        writeByte(address);
-        writeByte(data);
-        m_txPin->digital_write(false);
+void DaliBusComponent::sendForwardFrameTwice(uint8_t address, uint8_t data) {
+    if (is_direct()) {
+        DaliBusScheduler::instance().transmit_twice(this, ((uint32_t)address << 8) | data);
+        return;
     }
 
-    // Non critical delay
-    esp_rom_delay_us(HALF_BIT_PERIOD*2);
-    esp_rom_delay_us(BIT_PERIOD*4);
+    // One ring entry, the bus task sends the repeat right after the first frame
+    DaliTransaction transaction { DaliTransactionType::FORWARD, address, data, 0, 0, nullptr };
+    transaction.twice = true;
+    submit(transaction);
 }
 
-uint8_t DaliBusComponent::receiveBackwardFrame(unsigned long timeout_ms) {
-    uint8_t data;
+void DaliBusComponent::sendForwardFrame24(uint8_t address, uint8_t instance, uint8_t opcode) {
+    if (is_direct()) {
+        DaliBusScheduler::instance().transmit(this, ((uint32_t)address << 16) | ((uint32_t)instance << 8) | opcode, 24);
+        return;
+    }
 
-    int64_t startTime = esp_timer_get_time();
+    submit(DaliTransaction { DaliTransactionType::FORWARD, address, instance, 0, 0, nullptr, opcode, 24 });
+}
 
-    // Wait for START bit (timing critical)
-    while (m_rxPin->digital_read() == false) {
-        if ((esp_timer_get_time() - startTime) / 1000 >= timeout_ms) {
-            //Serial.println("No reply");
-            if (DEBUG_LOG_RXTX) {
-                DALI_LOGD("RX: 00 (NACK)");
-            }
-            return 0;
+void DaliBusComponent::sendForwardFrame24Twice(uint8_t address, uint8_t instance, uint8_t opcode) {
+    if (is_direct()) {
+        DaliBusScheduler::instance().transmit_twice(this, ((uint32_t)address << 16) | ((uint32_t)instance << 8) | opcode, 24);
+        return;
+    }
+
+    DaliTransaction transaction { DaliTransactionType::FORWARD, address, instance, 0, 0, nullptr, opcode, 24 };
+    transaction.twice = true;
+    submit(transaction);
+}
+
+uint8_t DaliBusComponent::sendQueryFrame24(uint8_t address, uint8_t instance, uint8_t opcode, unsigned long timeout_ms) {
+    uint8_t reply = 0;
+    if (is_direct()) {
+        if (DaliBusScheduler::instance().transmit(this, ((uint32_t)address << 16) | ((uint32_t)instance << 8) | opcode, 24)) {
+            reply = DaliBusScheduler::instance().receive(this, timeout_ms);
         }
+    } else {
+        uint8_t timeout = timeout_ms > 255 ? 255 : (uint8_t)timeout_ms;
+        uint32_t tag = submit(DaliTransaction { DaliTransactionType::QUERY, address, instance, timeout, next_tag(), nullptr, opcode, 24 });
+        reply = wait_for(tag);
     }
 
-    {
-        // This is timing critical
-        InterruptLock lock;
+    return reply;
+}
+
+uint8_t DaliBusComponent::sendQueryFrame(uint8_t address, uint8_t data, unsigned long timeout_ms) {
+    uint8_t reply = 0;
+    if (is_direct()) {
+        if (DaliBusScheduler::instance().transmit(this, ((uint32_t)address << 8) | data)) {
+            reply = DaliBusScheduler::instance().receive(this, timeout_ms);
+        }
+    } else {
+        uint8_t timeout = timeout_ms > 255 ? 255 : (uint8_t)timeout_ms;
+        uint32_t tag = submit(DaliTransaction { DaliTransactionType::QUERY, address, data, timeout, next_tag(), nullptr });
+        reply = wait_for(tag);
+    }
+
+    return reply;
+}
+
+void DaliBusComponent::sendQueryFrameAsync(uint8_t address, uint8_t data, DaliQueryCallback callback, unsigned long timeout_ms) {
+    if (is_direct()) {
+        // Already on the bus task (or not started yet), nothing to wait for
+        callback(sendQueryFrame(address, data, timeout_ms));
+        return;
+    }
 
-        esp_rom_delay_us(BIT_PERIOD);
-        esp_rom_delay_us(QUARTER_BIT_PERIOD);
-        data = readByte();
-        esp_rom_delay_us(BIT_PERIOD*2);
+    uint8_t timeout = timeout_ms > 255 ? 255 : (uint8_t)timeout_ms;
+    uint32_t tag = next_tag();
+    m_pending_queries.push_back(PendingQuery { tag, [callback](optional<uint8_t> reply) { callback(reply.value_or(0)); } });
+    submit(DaliTransaction { DaliTransactionType::QUERY, address, data, timeout, tag, nullptr });
+}
+
+void DaliBusComponent::query_async(short_addr_t short_addr, DaliCommand command, std::function<void(optional<uint8_t>)>&& callback) {
+    uint8_t address = (short_addr << 1) | DALI_COMMAND;
+    if (is_direct()) {
+        bool received = false;
+        uint8_t reply = 0;
+        if (DaliBusScheduler::instance().transmit(this, ((uint32_t)address << 8) | static_cast<uint8_t>(command))) {
+            reply = DaliBusScheduler::instance().receive(this, 100, &received);
+        }
+        if (received) {
+            callback(reply);
+        } else {
+            callback({});
+        }
+        return;
     }
 
-    //Serial.print("RX: "); Serial.println(data, HEX);
-    if (DEBUG_LOG_RXTX) {
-        DALI_LOGD("RX: %02x", data);
+    uint32_t tag = next_tag();
+    m_pending_queries.push_back(PendingQuery { tag, std::move(callback) });
+    submit(DaliTransaction { DaliTransactionType::QUERY, address, static_cast<uint8_t>(command), 100, tag, nullptr });
+}
+
+uint8_t DaliBusComponent::receiveBackwardFrame(unsigned long timeout_ms) {
+    uint8_t reply;
+    if (is_direct()) {
+        reply = DaliBusScheduler::instance().receive(this, timeout_ms);
+    } else {
+        uint8_t timeout = timeout_ms > 255 ? 255 : (uint8_t)timeout_ms;
+        uint32_t tag = submit(DaliTransaction { DaliTransactionType::RECEIVE, 0, 0, timeout, next_tag(), nullptr });
+        reply = wait_for(tag);
     }
 
-    // Minimum time before we can send another forward frame
-    esp_rom_delay_us(BIT_PERIOD*8);
-    return data;
+    return reply;
 }
@@ -1,17 +1,67 @@
 #pragma once
 
 #include <esphome.h>
+#include <deque>
+#include <vector>
 #include "dali.h"
+#include "esphome_dali_scheduler.h"
 
 namespace esphome {
 namespace dali {
 
+/// @brief Times a level write is repeated when verification finds the gear at another level
+#define DALI_VERIFY_RETRIES (3)
+
+/// @brief Receives the health of one device: QUERY_STATUS bits and LED_FAILURE_* bits
+/// (failure is only queried when the status reports a gear or lamp failure, 0 otherwise).
+/// A device that does not answer is reported with STATUS_GEAR_FAILURE.
+typedef std::function<void(short_addr_t short_addr, uint8_t status, uint8_t failure)> DaliHealthCallback;
+
 enum class DaliInitMode {
     DiscoverOnly,
     InitializeUnassigned,
     InitializeAll
 };
 
+struct DaliLightSlot;
+
+// DaliDeviceConfig::flags, set for the settings given in YAML
+#define DALI_CONFIG_FADE_TIME        (0x01)
+#define DALI_CONFIG_FADE_RATE        (0x02)
+#define DALI_CONFIG_MIN_LEVEL        (0x04)
+#define DALI_CONFIG_MAX_LEVEL        (0x08)
+#define DALI_CONFIG_POWER_ON_LEVEL   (0x10)
+#define DALI_CONFIG_BRIGHTNESS_CURVE (0x20)
+#define DALI_CONFIG_GROUPS           (0x40)
+#define DALI_CONFIG_VERIFY           (0x80)
+
+/// @brief Settings of one light. Codegen emits a constexpr table of these per bus.
+struct DaliDeviceConfig {
+    short_addr_t address;
+    uint8_t flags;
+    uint8_t fade_time;
+    uint8_t fade_rate;
+    uint8_t min_level;
+    uint8_t max_level;
+    uint8_t power_on_level;
+    DaliLedDimmingCurve brightness_curve;
+    uint16_t groups; ///< Bit n = member of group n
+
+    constexpr bool has(uint8_t flag) const { return (flags & flag) != 0; }
+};
+
+/// @brief Checked with static_assert on the generated table
+constexpr bool dali_device_table_unique(const DaliDeviceConfig* devices, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = i + 1; j < count; j++) {
+            if (devices[i].address == devices[j].address) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 class DaliBusComponent : public Component, public DaliPort {
 public:
     DaliBusComponent()
@@ -24,11 +74,37 @@ public:
     void dump_config() override;
 
     void set_tx_pin(GPIOPin* tx_pin) { m_txPin = tx_pin; }
-    void set_rx_pin(GPIOPin* rx_pin) { m_rxPin = rx_pin; }
+    void set_rx_pin(InternalGPIOPin* rx_pin) { m_rxPin = rx_pin; }
+
+    /// @brief Decode every frame on the bus, including those of other masters, and log it.
+    /// Edges are captured by an RX interrupt and decoded on the bus task, so bus timing is not affected.
+    void set_monitor(bool monitor) { m_monitor = monitor; }
+    /// @brief Listen for event frames of DALI-2 input devices (push buttons, occupancy sensors)
+    /// on the RX pin. Must be set before setup().
+    void set_input_events(bool input_events) { m_inputEvents = input_events; }
+    /// @brief Called from the main loop with the 24 bit frame of every input device event
+    void add_on_input_event_callback(std::function<void(uint32_t frame)>&& callback) {
+        m_inputEventCallback.add(std::move(callback));
+    }
+
+    /// @brief Called from the main loop for every monitored frame
+    void add_on_frame_callback(std::function<void(const DaliFrameRecord&)>&& callback) {
+        m_frameCallback.add(std::move(callback));
+    }
 
     /// @brief Perform automatic device discovery on setup.
     /// Light components will automatically be created and appear in HomeAssistant
     void do_device_discovery() { m_discovery = true; }
+    /// @brief Lights defined in YAML, discovery skips their addresses
+    void set_device_table(const DaliDeviceConfig* devices, uint8_t count) {
+        m_devices = devices;
+        m_deviceCount = count;
+    }
+    /// @brief Statically allocated storage for discovered lights, one slot per light
+    void set_light_pool(DaliLightSlot* pool, uint8_t size) {
+        m_lightPool = pool;
+        m_lightPoolSize = size;
+    }
 
     /// @brief Initialize long and short addresses for devices on the bus.
     /// @param mode 
@@ -37,39 +113,282 @@ public:
     /// @note
     void do_initialize_addresses(DaliInitMode mode = DaliInitMode::InitializeUnassigned) { m_initialize_addresses = mode; }
 
-    /// @brief Run device discovery scan manually (can be called after boot)
-    void run_discovery();
+    /// @brief Run device discovery scan manually (can be called after boot).
+    /// Addresses are only initialized by the first run at boot, later runs only discover.
+    /// @param wait Block until discovery finished and lights were created (used during setup)
+    void run_discovery(bool wait = false);
+
+    /// @brief Device management at runtime, for API services and buttons.
+    /// Multi-step operations run as background jobs and report through the progress callbacks.
+    void identify(short_addr_t short_addr);
+    void save_persistent_variables(short_addr_t short_addr);
+    /// @param new_addr New short address 0..63, or 0xFF to clear the short address.
+    /// Refused for devices that have a light, the light would stay on the old address.
+    void change_short_address(short_addr_t short_addr, short_addr_t new_addr);
+    /// @brief Called from the main loop as background operations progress, total is 0 while unknown
+    void add_on_progress_callback(std::function<void(std::string operation, uint32_t done, uint32_t total)>&& callback) {
+        m_progressCallback.add(std::move(callback));
+    }
+
+    /// @brief Run a job with exclusive access to this bus on the bus task
+    /// @param wait Block until the job finished, done() has run by the time this returns
+    void run_job(DaliJob* job, bool wait = false);
+
+    /// @brief Write a configuration batch as a background job with exclusive access to the bus
+    /// @param progress Called from the main loop as commands go out, may be null
+    void configure(DaliConfigBatch batch, DaliProgressCallback&& progress = nullptr);
+
+    /// @brief Check that a level write arrived once the fade is over, and resend it if not.
+    /// Verification queries only go out while the command ring is empty, one at a time, so they use
+    /// idle bus time. A newer write to the same address replaces a pending check.
+    /// @param short_addr Short address, groups and broadcast can not be queried
+    /// @param level Level sent with DAPC
+    /// @param expected Level QUERY_ACTUAL_LEVEL should report (level clamped to min/max)
+    /// @param delay_ms Time until the fade is expected to be finished
+    void verify_level(short_addr_t short_addr, uint8_t level, uint8_t expected, uint32_t delay_ms);
+    /// @brief Drop the check of a level that is no longer wanted, e.g. when dimming takes over
+    void cancel_verify(short_addr_t short_addr);
+
+    /// @brief Announce a light that will hand its boot level to restore_level(), from its setup
+    void expect_restore();
+    /// @brief Hold a level restored by a light during boot, so all restored levels go out together
+    /// @return false once the restored levels were sent, the caller then writes the level itself
+    bool restore_level(short_addr_t short_addr, uint8_t level);
+    /// @brief Send the restored levels: the most common one as a broadcast or group frame,
+    /// DAPC frames only for the lights that differ. Runs once, when the last announced light
+    /// restored its level, or after a timeout.
+    void flush_restore();
+    /// @brief Query min/max/power-on level, device type and colour features of every light
+    /// in one background sweep, so later reads of them do not touch the bus
+    void warm_attributes();
+
+    /// @brief Time between two health sweeps over the devices added with add_health_address()
+    void set_health_check_interval(uint32_t interval_ms) { m_healthInterval = interval_ms; }
+    /// @brief Include a device in the periodic health sweep
+    void add_health_address(short_addr_t short_addr);
+    void add_on_health_callback(DaliHealthCallback&& callback) { m_healthCallback.add(std::move(callback)); }
+
+    /// @brief False while the line is held active: no bus power or a short circuit.
+    /// Frames then fail at once instead of waiting for an idle line or a reply.
+    bool is_bus_up() const { return !m_busDownReported; }
+    /// @brief Called from the main loop when the bus goes down (false) and when it is back (true).
+    /// Lights hand their current level to restore_level() when it is back.
+    void add_on_bus_state_callback(std::function<void(bool up)>&& callback) { m_busStateCallback.add(std::move(callback)); }
+
+    /// @brief Frames that collided with another master, including ones that succeeded on retry
+    uint32_t get_collision_count() const { return m_collisions.load(std::memory_order_relaxed); }
+    /// @brief Frames given up after all collision retries, or because the line never went idle
+    uint32_t get_lost_frame_count() const { return m_lostFrames.load(std::memory_order_relaxed); }
 
     // NOTE: Must have a higher priority number than the components that depend on this.
     // ie, this must be initialized first.
     float get_setup_priority() const override { return setup_priority::HARDWARE; }
 
-    void register_static_addr(short_addr_t short_addr) {
-        if (short_addr < ADDR_SHORT_MAX) {
-            m_addresses[short_addr] = 0xFFFFFF;
-        }
-    }
-
     DaliMaster dali;
 
 public: // DaliPort
     void resetBus() override;
     void sendForwardFrame(uint8_t address, uint8_t data) override;
     uint8_t receiveBackwardFrame(unsigned long timeout_ms = 100) override;
+    uint8_t sendQueryFrame(uint8_t address, uint8_t data, unsigned long timeout_ms = 100) override;
+    void sendForwardFrameTwice(uint8_t address, uint8_t data) override;
+    void sendForwardFrame24(uint8_t address, uint8_t instance, uint8_t opcode) override;
+    void sendForwardFrame24Twice(uint8_t address, uint8_t instance, uint8_t opcode) override;
+    uint8_t sendQueryFrame24(uint8_t address, uint8_t instance, uint8_t opcode, unsigned long timeout_ms = 100) override;
+    void sendQueryFrameAsync(uint8_t address, uint8_t data, DaliQueryCallback callback, unsigned long timeout_ms = 100) override;
+
+    /// @brief Like dali.queryAsync(), but the callback gets no value when nothing answered,
+    /// where queryAsync() passes 0 and a device replying 0 looks the same
+    void query_async(short_addr_t short_addr, DaliCommand command, std::function<void(optional<uint8_t>)>&& callback);
 
 private:
-    void writeBit(bool bit);
-    void writeByte(uint8_t b);
-    uint8_t readByte();
+    friend class DaliBusScheduler;
+
+    /// @brief True when bus I/O can be done right here (on the bus task, or before it started)
+    bool is_direct() const;
+    /// @brief Push to the command ring, waits for room if it is full and handles completions meanwhile
+    uint32_t submit(DaliTransaction transaction);
+    /// @brief Block until the completion for tag arrives, handling other completions meanwhile
+    uint8_t wait_for(uint32_t tag);
+    void process_completion(const DaliCompletion& completion);
+    uint32_t next_tag();
+
+    /// @brief Discovery body, runs on the bus task
+    void discover_devices(const DaliProgressCallback& progress);
+    /// @brief Create light components for discovered devices, runs on the main loop
+    void create_discovered_lights();
+
+    /// @brief Queue a bus job that reads bank 0 of the given devices, unless the cached
+    /// identity of that short address still matches the serial number. Runs after the
+    /// lights were created, so it does not hold up boot.
+    void read_identities(uint64_t devices);
+    /// @brief Bus task part of read_identities()
+    void query_identities(uint64_t devices);
+    void send_restore();
 
     void create_light_component(short_addr_t short_addr, uint32_t long_addr);
+    /// @brief True if a light for this short address is defined in YAML or was created by discovery
+    bool has_light(short_addr_t short_addr) const;
 
-    GPIOPin* m_rxPin;
+    static void rx_edge_isr(DaliBusComponent* bus);
+    /// @brief Set before the interrupt is attached, so the ISR does not call the non-IRAM instance()
+    DaliBusScheduler* m_scheduler = nullptr;
+    void log_frame(const DaliFrameRecord& frame);
+    /// @brief Start the next due verification query if the bus is idle
+    void process_verify();
+    /// @brief Query the next device of a health sweep if the bus is idle
+    void process_health();
+    /// @brief Bus power lost or back, reported by the bus task
+    void process_bus_state();
+    /// @brief Log the measured bit timing, warn if it is outside the IEC 62386-101 limits
+    void report_timing();
+    void report_loopback();
+
+    struct ProgressJob;
+    /// @brief Run a job that reports progress. run() gets a callback that is safe to call from the bus task.
+    void run_progress_job(const char* operation, std::function<void(const DaliProgressCallback&)>&& run,
+        DaliProgressCallback&& progress, std::function<void()>&& done = nullptr, bool wait = false);
+    void report_progress(ProgressJob& job);
+
+    InternalGPIOPin* m_rxPin;
     GPIOPin* m_txPin;
 
     bool m_discovery = false;
     DaliInitMode m_initialize_addresses = DaliInitMode::DiscoverOnly;
-    uint32_t m_addresses[ADDR_SHORT_MAX+1] = {0};
+    // Mode of the discovery in progress, m_initialize_addresses only applies to the one at boot
+    DaliInitMode m_discoveryMode = DaliInitMode::DiscoverOnly;
+    bool m_bootDiscovery = true;
+    const DaliDeviceConfig* m_devices = nullptr;
+    uint8_t m_deviceCount = 0;
+    uint64_t m_discoveredLights = 0;
+
+    // Filled by discover_devices() on the bus task, consumed by create_discovered_lights()
+    struct DiscoveredDevice {
+        short_addr_t short_addr;
+        uint32_t long_addr;
+    };
+    DiscoveredDevice m_discovered[ADDR_SHORT_MAX+1];
+    uint8_t m_discovered_count = 0;
+    // Short addresses the scan found, and whether it saw every device (none unaddressed or duplicated)
+    uint64_t m_scanGear = 0;
+    bool m_scanComplete = false;
+    // Copied from the scan on the main loop, send_restore() only broadcasts when it covers the whole bus
+    uint64_t m_busGear = 0;
+    bool m_busGearComplete = false;
+
+    // Bank 0 identity per short address, cached in flash so discovery does not read it on every boot.
+    // Only allocated with discovery enabled.
+    struct IdentityCache {
+        uint64_t known; ///< Bit n = entries[n] is valid
+        DaliIdentity entries[ADDR_SHORT_MAX+1];
+    };
+    IdentityCache* m_identities = nullptr;
+    ESPPreferenceObject m_identityPref;
+    bool m_identitiesChanged = false;
+
+    DaliLightSlot* m_lightPool = nullptr;
+    uint8_t m_lightPoolSize = 0;
+    uint8_t m_lightPoolUsed = 0;
+
+    // Main loop -> bus task
+    DaliRing<DaliTransaction, DALI_COMMAND_RING> m_commands;
+    // Bus task -> main loop
+    DaliRing<DaliCompletion, DALI_COMPLETION_RING> m_completions;
+    // Task blocked in wait_for(), notified when a completion is pushed
+    std::atomic<TaskHandle_t> m_waiter { nullptr };
+    // Calls of wait_for() on the main loop, innermost first
+    struct Waiter {
+        uint32_t tag;
+        bool done;
+        uint8_t reply;
+        Waiter* outer;
+    };
+    Waiter* m_waitChain = nullptr;
+    uint32_t m_next_tag = 0;
+    // Callbacks of asynchronous queries. Completions arrive in submission order, so a FIFO is enough.
+    struct PendingQuery {
+        uint32_t tag;
+        std::function<void(optional<uint8_t>)> callback;
+    };
+    std::deque<PendingQuery> m_pending_queries;
+
+    // Bus monitor, the rings are only allocated when monitoring or listening for input events.
+    // RX interrupt -> bus task
+    bool m_monitor = false;
+    bool m_inputEvents = false;
+    CallbackManager<void(uint32_t)> m_inputEventCallback;
+    ISRInternalGPIOPin m_rxIsr;
+    DaliRing<DaliEdge, DALI_MONITOR_EDGE_RING>* m_monitorEdges = nullptr;
+    std::atomic<bool> m_monitorPaused { false };
+    DaliFrameDecoder m_monitorDecoder;
+    // Bus task -> main loop
+    DaliRing<DaliFrameRecord, DALI_MONITOR_FRAME_RING>* m_monitorFrames = nullptr;
+    std::atomic<uint32_t> m_monitorDropped { 0 };
+    uint32_t m_monitorDroppedReported = 0;
+    CallbackManager<void(const DaliFrameRecord&)> m_frameCallback;
+
+    // Line state tracked by the bus task for multi-master arbitration
+    int64_t m_idleSince = 0;
+    int64_t m_watchedAt = 0;
+    std::atomic<uint32_t> m_collisions { 0 };
+    std::atomic<uint32_t> m_lostFrames { 0 };
+    uint32_t m_collisionsReported = 0;
+    uint32_t m_lostFramesReported = 0;
+
+    // Bus power, a line that stays active is down. Sampled by the bus task.
+    bool m_lineActive = false;
+    int64_t m_lineChangedAt = 0;
+    std::atomic<bool> m_busDown { false };
+    bool m_busDownReported = false;
+    CallbackManager<void(bool)> m_busStateCallback;
+
+    // Bit timing. Calibrated by a job before the first frame, the loopback delays of the
+    // START bit are measured on every frame we send: active << 16 | idle in us, 0 until measured.
+    DaliBitTiming m_timing;
+    std::atomic<uint32_t> m_loopback { 0 };
+    bool m_loopbackReported = false;
+
+    // Level writes waiting to be verified, main loop only
+    struct PendingVerify {
+        short_addr_t short_addr;
+        uint8_t level;
+        uint8_t expected;
+        uint8_t attempts;
+        uint32_t delay_ms;
+        uint32_t due_ms;
+    };
+    std::vector<PendingVerify> m_verify;
+    bool m_verifyInFlight = false;
+    uint64_t m_verifyCancelled = 0;
+
+    // Levels restored by lights during boot, main loop only
+    bool m_restoring = true;
+    // Lights announced by expect_restore() that have not restored their level yet
+    uint8_t m_restorePending = 0;
+    uint32_t m_restoreSince = 0;
+    uint64_t m_restoreMask = 0;
+    uint8_t m_restoreLevels[ADDR_SHORT_MAX+1];
+
+    // Health sweep, main loop only. QUERY_STATUS is a cheap first-level filter,
+    // the DT6 failure status is only queried when it reports a failure.
+    std::vector<short_addr_t> m_healthAddresses;
+    CallbackManager<void(short_addr_t, uint8_t, uint8_t)> m_healthCallback;
+    uint32_t m_healthInterval = 60000;
+    uint32_t m_healthSweepStart = 0;
+    size_t m_healthIndex = 0;
+    bool m_healthSweeping = false;
+    bool m_healthInFlight = false;
+
+    // Jobs reporting progress in the order they were queued, the front one is running.
+    // Progress is written by the bus task, packed as done << 16 | total.
+    struct ProgressJob {
+        const char* operation;
+        std::atomic<uint32_t> progress { 0 };
+        uint32_t reported = 0;
+        DaliProgressCallback callback;
+    };
+    std::deque<std::shared_ptr<ProgressJob>> m_progressJobs;
+    CallbackManager<void(std::string, uint32_t, uint32_t)> m_progressCallback;
 };
 
 }  // namespace dali
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <esphome.h>
+#include "esphome/core/automation.h"
+#include "esphome_dali.h"
+#include "esphome_dali_light.h"
+
+namespace esphome {
+namespace dali {
+
+template<typename... Ts> class DaliIdentifyAction : public Action<Ts...>, public Parented<DaliBusComponent> {
+public:
+    TEMPLATABLE_VALUE(uint8_t, address)
+
+    void play(Ts... x) override { this->parent_->identify(this->address_.value(x...)); }
+};
+
+template<typename... Ts> class DaliSavePersistentVariablesAction : public Action<Ts...>, public Parented<DaliBusComponent> {
+public:
+    TEMPLATABLE_VALUE(uint8_t, address)
+
+    void play(Ts... x) override { this->parent_->save_persistent_variables(this->address_.value(x...)); }
+};
+
+/// @brief Moves a device to a new short address, or clears it when new_address is 0xFF
+template<typename... Ts> class DaliChangeShortAddressAction : public Action<Ts...>, public Parented<DaliBusComponent> {
+public:
+    TEMPLATABLE_VALUE(uint8_t, address)
+    TEMPLATABLE_VALUE(uint8_t, new_address)
+
+    void play(Ts... x) override {
+        this->parent_->change_short_address(this->address_.value(x...), this->new_address_.value(x...));
+    }
+};
+
+template<typename... Ts> class DaliRunDiscoveryAction : public Action<Ts...>, public Parented<DaliBusComponent> {
+public:
+    void play(Ts... x) override { this->parent_->run_discovery(); }
+};
+
+/// @brief Hold-to-dim for dali lights, the gear fades until DaliStopDimAction
+/// @remark Codegen resolves the light id to its DaliLight output, other platforms are rejected
+template<typename... Ts> class DaliStartDimAction : public Action<Ts...> {
+public:
+    explicit DaliStartDimAction(DaliLight* light)
+        : light_(light)
+    { }
+
+    TEMPLATABLE_VALUE(bool, up)
+    void set_step(bool step) { step_ = step; }
+
+    void play(Ts... x) override { this->light_->start_dim(this->up_.value(x...), this->step_); }
+
+protected:
+    DaliLight* light_;
+    bool step_ = false;
+};
+
+template<typename... Ts> class DaliStopDimAction : public Action<Ts...> {
+public:
+    explicit DaliStopDimAction(DaliLight* light)
+        : light_(light)
+    { }
+
+    void play(Ts... x) override { this->light_->stop_dim(); }
+
+protected:
+    DaliLight* light_;
+};
+
+class DaliProgressTrigger : public Trigger<std::string, uint32_t, uint32_t> {
+public:
+    explicit DaliProgressTrigger(DaliBusComponent* parent) {
+        parent->add_on_progress_callback([this](std::string operation, uint32_t done, uint32_t total) {
+            this->trigger(operation, done, total);
+        });
+    }
+};
+
+}  // namespace dali
+}  // namespace esphome
@@ -0,0 +1,67 @@
+#include <esphome.h>
+#include "esphome_dali_binary_sensor.h"
+
+#ifdef USE_BINARY_SENSOR
+
+using namespace esphome;
+using namespace dali;
+
+static const char *const TAG = "dali.binary_sensor";
+
+void DaliHealthSensor::setup() {
+    this->bus->add_health_address(this->address_);
+    this->bus->add_on_health_callback([this](short_addr_t short_addr, uint8_t status, uint8_t failure) {
+        if (short_addr != this->address_) {
+            return;
+        }
+        uint16_t flags = ((uint16_t)failure << 8) | status;
+        this->publish_state((flags & static_cast<uint16_t>(this->type_)) != 0);
+    });
+}
+
+void DaliHealthSensor::dump_config() {
+    ESP_LOGCONFIG(TAG, "DALI Health Sensor '%s':", this->get_name().c_str());
+    ESP_LOGCONFIG(TAG, "  Address: %.2x", this->address_);
+    ESP_LOGCONFIG(TAG, "  Flag: %04x", static_cast<uint16_t>(this->type_));
+}
+
+void DaliBusStatusSensor::setup() {
+    this->bus->add_on_bus_state_callback([this](bool up) { this->publish_state(up); });
+    this->publish_initial_state(this->bus->is_bus_up());
+}
+
+void DaliBusStatusSensor::dump_config() {
+    ESP_LOGCONFIG(TAG, "DALI Bus Status Sensor '%s':", this->get_name().c_str());
+    ESP_LOGCONFIG(TAG, "  Bus: %s", this->bus->is_bus_up() ? "up" : "DOWN");
+}
+
+void DaliInputBinarySensor::setup() {
+    this->bus->add_on_input_event_callback([this](uint32_t frame) {
+        if (!DALI_EVENT_IS_DEVICE_INSTANCE(frame)
+            || DALI_EVENT_SHORT_ADDRESS(frame) != this->address_
+            || DALI_EVENT_INSTANCE(frame) != this->instance_) {
+            return;
+        }
+
+        uint16_t info = DALI_EVENT_INFO(frame);
+        switch (this->type_) {
+            case DaliInputType::BUTTON:
+                if (info == BUTTON_EVENT_PRESSED) {
+                    this->publish_state(true);
+                } else if (info == BUTTON_EVENT_RELEASED) {
+                    this->publish_state(false);
+                }
+                break;
+            case DaliInputType::OCCUPANCY:
+                this->publish_state((info & OCCUPANCY_EVENT_OCCUPIED) != 0);
+                break;
+        }
+    });
+}
+
+void DaliInputBinarySensor::dump_config() {
+    ESP_LOGCONFIG(TAG, "DALI Input Binary Sensor '%s':", this->get_name().c_str());
+    ESP_LOGCONFIG(TAG, "  Address: %.2x, instance: %d", this->address_, this->instance_);
+}
+
+#endif  // USE_BINARY_SENSOR
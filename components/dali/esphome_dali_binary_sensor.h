@@ -0,0 +1,95 @@
+#pragma once
+
+#include <esphome.h>
+
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome_dali.h"
+
+namespace esphome {
+namespace dali {
+
+/// @brief Failure reported by a health sensor. The low byte selects QUERY_STATUS bits,
+/// the high byte DT6 QUERY_FAILURE_STATUS bits.
+enum class DaliHealthType : uint16_t {
+    GEAR_FAILURE = STATUS_GEAR_FAILURE,
+    LAMP_FAILURE = STATUS_LAMP_FAILURE,
+    SHORT_CIRCUIT = LED_FAILURE_SHORT_CIRCUIT << 8,
+    OPEN_CIRCUIT = LED_FAILURE_OPEN_CIRCUIT << 8,
+    LOAD_DECREASE = LED_FAILURE_LOAD_DECREASE << 8,
+    LOAD_INCREASE = LED_FAILURE_LOAD_INCREASE << 8,
+    CURRENT_PROTECTOR_ACTIVE = LED_FAILURE_CURRENT_PROTECTOR_ACTIVE << 8,
+    THERMAL_SHUTDOWN = LED_FAILURE_THERMAL_SHUTDOWN << 8,
+    THERMAL_OVERLOAD = LED_FAILURE_THERMAL_OVERLOAD << 8,
+    REFERENCE_MEASUREMENT_FAILED = LED_FAILURE_REFERENCE_MEASUREMENT_FAILED << 8,
+};
+
+/// @brief Reports one failure condition of a control gear, updated by the bus health sweep
+class DaliHealthSensor : public binary_sensor::BinarySensor, public Component {
+public:
+    DaliHealthSensor(DaliBusComponent* parent)
+        : bus(parent)
+    { }
+
+    void setup() override;
+    void dump_config() override;
+
+    void set_address(short_addr_t address) { address_ = address; }
+    void set_type(DaliHealthType type) { type_ = type; }
+
+    float get_setup_priority() const override { return setup_priority::DATA; }
+
+protected:
+    DaliBusComponent* bus;
+    short_addr_t address_ = 0;
+    DaliHealthType type_ = DaliHealthType::GEAR_FAILURE;
+};
+
+/// @brief On while the bus has power, off while the line is held active (PSU failure or short circuit)
+class DaliBusStatusSensor : public binary_sensor::BinarySensor, public Component {
+public:
+    DaliBusStatusSensor(DaliBusComponent* parent)
+        : bus(parent)
+    { }
+
+    void setup() override;
+    void dump_config() override;
+
+    float get_setup_priority() const override { return setup_priority::DATA; }
+
+protected:
+    DaliBusComponent* bus;
+};
+
+/// @brief State of a DALI-2 input device instance, from the event frames it sends
+enum class DaliInputType : uint8_t {
+    BUTTON,    ///< On while a push button is pressed
+    OCCUPANCY, ///< On while an occupancy sensor reports occupied
+};
+
+class DaliInputBinarySensor : public binary_sensor::BinarySensor, public Component {
+public:
+    DaliInputBinarySensor(DaliBusComponent* parent)
+        : bus(parent)
+    { }
+
+    void setup() override;
+    void dump_config() override;
+
+    void set_address(short_addr_t address) { address_ = address; }
+    void set_instance(uint8_t instance) { instance_ = instance; }
+    void set_type(DaliInputType type) { type_ = type; }
+
+    float get_setup_priority() const override { return setup_priority::DATA; }
+
+protected:
+    DaliBusComponent* bus;
+    short_addr_t address_ = 0;
+    uint8_t instance_ = 0;
+    DaliInputType type_ = DaliInputType::BUTTON;
+};
+
+}  // namespace dali
+}  // namespace esphome
+
+#endif  // USE_BINARY_SENSOR
@@ -0,0 +1,123 @@
+#include <esphome.h>
+#include "esphome_dali_effects.h"
+#include "esphome_dali_light.h"
+#include "esphome/core/log.h"
+#include <cmath>
+
+using namespace esphome;
+using namespace dali;
+
+static const char *const TAG = "dali.effect";
+
+// Longest DALI fade time (fade time 15)
+static const uint32_t MAX_FADE_MS = 90510;
+
+// Shortest phase, so a fade time of 0 does not send a frame on every loop
+static const uint32_t MIN_PHASE_MS = 200;
+
+// IDENTIFY_DEVICE runs for 10 seconds
+static const uint32_t IDENTIFY_MS = 10000;
+
+dali::DaliLight* dali::DaliEffect::light_() const {
+    return static_cast<DaliLight*>(this->state_->get_output());
+}
+
+bool dali::DaliEffect::next_phase_(uint32_t duration_ms) {
+    uint32_t now = millis();
+    if (this->started_ && (int32_t)(now - this->phase_end_) < 0) {
+        return false;
+    }
+    this->started_ = true;
+    this->phase_end_ = now + std::max(duration_ms, MIN_PHASE_MS);
+    return true;
+}
+
+void dali::DaliPulseEffect::start() {
+    this->light_()->begin_effect(this->fade_time_, 0xFF);
+    this->up_ = true;
+    this->restart_();
+}
+
+void dali::DaliPulseEffect::stop() {
+    this->light_()->end_effect();
+}
+
+void dali::DaliPulseEffect::apply() {
+    if (!this->next_phase_(dali_fade_time_ms(this->fade_time_))) {
+        return;
+    }
+
+    // RECALL_MAX/MIN_LEVEL jump without fading, DAPC fades with the fade time
+    DaliLight* light = this->light_();
+    uint8_t level = this->up_ ? light->get_max_level() : light->get_min_level();
+    light->get_bus()->dali.lamp.setBrightness(light->get_address(), level);
+    this->up_ = !this->up_;
+}
+
+void dali::DaliBreatheEffect::start() {
+    this->light_()->begin_effect(0xFF, this->fade_rate_);
+    this->up_ = true;
+    this->restart_();
+}
+
+void dali::DaliBreatheEffect::stop() {
+    this->light_()->end_effect();
+}
+
+void dali::DaliBreatheEffect::apply() {
+    DaliLight* light = this->light_();
+
+    // F = 506 / sqrt(2^fade_rate) steps/second
+    float steps_per_second = 506.0f / sqrtf((float)(1u << this->fade_rate_));
+    uint32_t ramp_ms = (uint32_t)((light->get_max_level() - light->get_min_level()) * 1000.0f / steps_per_second);
+    if (!this->next_phase_(ramp_ms)) {
+        return;
+    }
+
+    if (this->up_) {
+        light->get_bus()->dali.lamp.continuousUp(light->get_address());
+    } else {
+        light->get_bus()->dali.lamp.continuousDown(light->get_address());
+    }
+    this->up_ = !this->up_;
+}
+
+void dali::DaliWakeUpEffect::start() {
+    this->steps_ = (uint8_t)std::max<uint32_t>(1, (this->duration_ms_ + MAX_FADE_MS - 1) / MAX_FADE_MS);
+    this->step_ = 0;
+
+    // Closest fade time to one step: T = 0.5 * 2^(n/2) seconds
+    float step_ms = (float)this->duration_ms_ / this->steps_;
+    int fade_time = (int)lroundf(2.0f * log2f(std::max(step_ms, 500.0f) / 500.0f));
+    if (fade_time < 1) fade_time = 1;
+    if (fade_time > 15) fade_time = 15;
+
+    ESP_LOGD(TAG, "Wake-up over %us: %d step(s) with fade time %d",
+        (unsigned)(this->duration_ms_ / 1000), this->steps_, fade_time);
+    this->light_()->begin_effect((uint8_t)fade_time, 0xFF);
+    this->restart_();
+}
+
+void dali::DaliWakeUpEffect::stop() {
+    this->light_()->end_effect();
+}
+
+void dali::DaliWakeUpEffect::apply() {
+    if (this->step_ >= this->steps_ || !this->next_phase_(this->duration_ms_ / this->steps_)) {
+        return;
+    }
+
+    // The gear fades each step itself, the last one ends at the requested brightness
+    this->step_++;
+    DaliLight* light = this->light_();
+    uint8_t level = light->brightness_to_level(this->brightness_ * this->step_ / this->steps_);
+    light->get_bus()->dali.lamp.setBrightness(light->get_address(), level);
+}
+
+void dali::DaliIdentifyEffect::apply() {
+    if (!this->next_phase_(IDENTIFY_MS)) {
+        return;
+    }
+    DaliLight* light = this->light_();
+    light->get_bus()->dali.identifyDevice(light->get_address());
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <esphome.h>
+#include "esphome/components/light/light_effect.h"
+#include "esphome_dali.h"
+
+namespace esphome {
+namespace dali {
+
+class DaliLight;
+
+/// @brief Effect animated by the gear itself. apply() runs every loop but only sends
+/// a frame when a phase of the animation is over, a few frames per cycle in total.
+/// @remark Only for DALI lights, the light output is assumed to be a DaliLight. light.py rejects
+/// the effects on lights of other platforms.
+class DaliEffect : public light::LightEffect {
+public:
+    explicit DaliEffect(const std::string& name)
+        : LightEffect(name)
+    { }
+
+protected:
+    DaliLight* light_() const;
+
+    /// @brief True when the current phase is over, the next one then ends after duration_ms
+    bool next_phase_(uint32_t duration_ms);
+    /// @brief Make next_phase_() return true on the next apply()
+    void restart_() { this->started_ = false; }
+
+private:
+    bool started_ = false;
+    uint32_t phase_end_ = 0;
+};
+
+/// @brief Fades between min and max level with DAPC, timed by the fade time
+class DaliPulseEffect : public DaliEffect {
+public:
+    explicit DaliPulseEffect(const std::string& name)
+        : DaliEffect(name)
+    { }
+
+    void set_fade_time(uint8_t fade_time) { fade_time_ = fade_time; }
+
+    void start() override;
+    void stop() override;
+    void apply() override;
+
+protected:
+    uint8_t fade_time_ = 1;
+    bool up_ = true;
+};
+
+/// @brief Ramps between min and max level with CONTINUOUS_UP / CONTINUOUS_DOWN, paced by the fade rate
+class DaliBreatheEffect : public DaliEffect {
+public:
+    explicit DaliBreatheEffect(const std::string& name)
+        : DaliEffect(name)
+    { }
+
+    void set_fade_rate(uint8_t fade_rate) { fade_rate_ = fade_rate; }
+
+    void start() override;
+    void stop() override;
+    void apply() override;
+
+protected:
+    uint8_t fade_rate_ = 7;
+    bool up_ = true;
+};
+
+/// @brief Slow fade from off to a brightness. Fade times top out at 90.5 s,
+/// so longer wake-ups are split into a few DAPC steps.
+class DaliWakeUpEffect : public DaliEffect {
+public:
+    explicit DaliWakeUpEffect(const std::string& name)
+        : DaliEffect(name)
+    { }
+
+    void set_duration(uint32_t duration_ms) { duration_ms_ = duration_ms; }
+    void set_brightness(float brightness) { brightness_ = brightness; }
+
+    void start() override;
+    void stop() override;
+    void apply() override;
+
+protected:
+    uint32_t duration_ms_ = 300000;
+    float brightness_ = 1.0f;
+    uint8_t steps_ = 1;
+    uint8_t step_ = 0;
+};
+
+/// @brief Repeats IDENTIFY_DEVICE, the gear runs its own identification pattern
+class DaliIdentifyEffect : public DaliEffect {
+public:
+    explicit DaliIdentifyEffect(const std::string& name)
+        : DaliEffect(name)
+    { }
+
+    void apply() override;
+};
+
+}  // namespace dali
+}  // namespace esphome
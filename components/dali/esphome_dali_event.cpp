@@ -0,0 +1,49 @@
+#include <esphome.h>
+#include "esphome_dali_event.h"
+
+#ifdef USE_EVENT
+
+using namespace esphome;
+using namespace dali;
+
+static const char *const TAG = "dali.event";
+
+/// @brief Event type for push button event info, nullptr for codes that are not forwarded
+static const char* button_event_type(uint16_t info) {
+    switch (info) {
+        case BUTTON_EVENT_RELEASED: return "released";
+        case BUTTON_EVENT_PRESSED: return "pressed";
+        case BUTTON_EVENT_SHORT_PRESS: return "short_press";
+        case BUTTON_EVENT_DOUBLE_PRESS: return "double_press";
+        case BUTTON_EVENT_LONG_PRESS_START: return "long_press_start";
+        case BUTTON_EVENT_LONG_PRESS_REPEAT: return "long_press_repeat";
+        case BUTTON_EVENT_LONG_PRESS_STOP: return "long_press_stop";
+        case BUTTON_EVENT_FREE: return "free";
+        case BUTTON_EVENT_STUCK: return "stuck";
+        default: return nullptr;
+    }
+}
+
+void DaliInputEvent::setup() {
+    this->bus->add_on_input_event_callback([this](uint32_t frame) {
+        if (!DALI_EVENT_IS_DEVICE_INSTANCE(frame)
+            || DALI_EVENT_SHORT_ADDRESS(frame) != this->address_
+            || DALI_EVENT_INSTANCE(frame) != this->instance_) {
+            return;
+        }
+
+        const char* event_type = button_event_type(DALI_EVENT_INFO(frame));
+        if (event_type == nullptr) {
+            ESP_LOGD(TAG, "DALI[%.2x:%d] Unknown event %03x", this->address_, this->instance_, (unsigned)DALI_EVENT_INFO(frame));
+            return;
+        }
+        this->trigger(event_type);
+    });
+}
+
+void DaliInputEvent::dump_config() {
+    ESP_LOGCONFIG(TAG, "DALI Input Event '%s':", this->get_name().c_str());
+    ESP_LOGCONFIG(TAG, "  Address: %.2x, instance: %d", this->address_, this->instance_);
+}
+
+#endif  // USE_EVENT
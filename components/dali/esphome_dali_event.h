@@ -0,0 +1,36 @@
+#pragma once
+
+#include <esphome.h>
+
+#ifdef USE_EVENT
+#include "esphome/components/event/event.h"
+#include "esphome_dali.h"
+
+namespace esphome {
+namespace dali {
+
+/// @brief Fires the push button events of one DALI-2 input device instance (IEC 62386-301)
+class DaliInputEvent : public event::Event, public Component {
+public:
+    DaliInputEvent(DaliBusComponent* parent)
+        : bus(parent)
+    { }
+
+    void setup() override;
+    void dump_config() override;
+
+    void set_address(short_addr_t address) { address_ = address; }
+    void set_instance(uint8_t instance) { instance_ = instance; }
+
+    float get_setup_priority() const override { return setup_priority::DATA; }
+
+protected:
+    DaliBusComponent* bus;
+    short_addr_t address_ = 0;
+    uint8_t instance_ = 0;
+};
+
+}  // namespace dali
+}  // namespace esphome
+
+#endif  // USE_EVENT
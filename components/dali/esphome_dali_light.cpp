@@ -2,6 +2,7 @@
 #include <esphome.h>
 #include "esphome_dali_light.h"
 #include "esphome/core/log.h"
+#include <cmath>
 
 using namespace esphome;
 using namespace dali;
@@ -10,94 +11,73 @@ using namespace esphome::light;
 
 static const char *const TAG = "dali.light";
 
-#define DALI_MAX_BRIGHTNESS_F (254.0f)
+// Extra time after the fade before the level is read back
+static const uint32_t VERIFY_MARGIN_MS = 250;
+
+// UP/DOWN fade for 200 ms
+static const uint32_t DIM_STEP_MS = 200;
+
+// State sync without a restored level written by then
+static const uint32_t STATE_SYNC_TIMEOUT_MS = 2000;
+
+// How often the energy sensor is published while the level does not change
+static const uint32_t ENERGY_PUBLISH_INTERVAL_MS = 60000;
+
+/// @brief Relative light output (0.001..1) for an arc level on the standard logarithmic curve
+/// @remark P = 10^((level-1)/(253/3)) * P_100%/1000
+static float dali_log_level_to_power(float level) {
+    return powf(10.0f, (level - 1.0f) * 3.0f / 253.0f - 3.0f);
+}
+
+static float dali_log_power_to_level(float power) {
+    return 1.0f + (253.0f / 3.0f) * (log10f(power) + 3.0f);
+}
 
 void dali::DaliLight::setup_state(light::LightState *state) {
     // Initialization code for DaliLight
     this->light_state_ = state;
 
-    // Exclude broadcast and group addresses
-    if ((this->address_ != ADDR_BROADCAST) && ((this->address_ & ADDR_GROUP_MASK) == 0)) {
-        ESP_LOGD(TAG, "Querying DALI device capabilities...");
-        if (bus->dali.isDevicePresent(address_)) {
-            ESP_LOGD(TAG, "DALI[%.2x] Is Present", address_);
-
-            uint8_t query_min = bus->dali.lamp.getMinLevel(address_);
-            uint8_t query_max = bus->dali.lamp.getMaxLevel(address_);
-            
-            // Validate query results (0 or 255 typically indicate timeout/error)
-            if (query_min >= 1 && query_min <= 254 && query_max >= 1 && query_max <= 254 && query_max > query_min) {
-                this->dali_level_min_ = query_min;
-                this->dali_level_max_ = query_max;
-                this->dali_level_range_ = (float)(dali_level_max_ - this->dali_level_min_ + 1);
-                ESP_LOGD(TAG, "Reported min:%d max:%d", this->dali_level_min_, this->dali_level_max_);
-            } else {
-                ESP_LOGW(TAG, "DALI[%.2x] Invalid query response (min=%d max=%d), keeping defaults", address_, query_min, query_max);
-            }
-
-            // Color temperature support disabled - only brightness mode used
-            // If you need color temp, uncomment and set color_mode: COLOR_TEMPERATURE in YAML
-            // this->tc_supported_ = bus->dali.color.isTcCapable(address_);
-
-            // Schedule a delayed task to:
-            // 1. Read actual device state FIRST (without changing lights)
-            // 2. Send configuration commands AFTER syncing state
-            this->set_timeout("dali_state_sync", 1000, [this]() {
-                if (this->light_state_ == nullptr) return;
-
-                // Step 1: Query current state from device
-                uint8_t current_level = this->bus->dali.lamp.getCurrentLevel(this->address_);
-                ESP_LOGD(TAG, "DALI[%.2x] Delayed state query returned: %d", this->address_, current_level);
-
-                // Accept 0..255 (255 = full brightness on some devices)
-                float brightness = 0.0f;
-                if (current_level == 0) {
-                    brightness = 0.0f;
-                } else if (current_level >= 255) {
-                    brightness = 1.0f; // clamp
-                } else {
-                    brightness = (current_level / DALI_MAX_BRIGHTNESS_F);
-                }
-
-                this->light_state_->current_values.set_brightness(brightness);
-                this->light_state_->current_values.set_state(current_level > 0);
-                this->light_state_->remote_values.set_brightness(brightness);
-                this->light_state_->remote_values.set_state(current_level > 0);
-                this->light_state_->publish_state();
-
-                ESP_LOGD(TAG, "DALI[%.2x] Synced from bus: level=%d brightness=%.2f", this->address_, current_level, brightness);
-
-                // Step 2: NOW send configuration commands (after state is synced)
-                ESP_LOGD(TAG, "DALI[%.2x] Sending configuration to device...", this->address_);
-
-                if (this->brightness_curve_.has_value()) {
-                    switch (this->brightness_curve_.value()) {
-                        case DaliLedDimmingCurve::LOGARITHMIC: ESP_LOGD(TAG, "Setting brightness curve to LOGARITHMIC"); break;
-                        case DaliLedDimmingCurve::LINEAR:      ESP_LOGD(TAG, "Setting brightness curve to LINEAR"); break;
-                    }
-                    this->bus->dali.led.setDimmingCurve(this->address_, this->brightness_curve_.value());
-                }
-
-                if (this->fade_rate_.has_value()) {
-                    ESP_LOGD(TAG, "Setting fade rate: %d", this->fade_rate_.value());
-                    this->bus->dali.lamp.setFadeRate(this->address_, this->fade_rate_.value());
-                }
-                if (this->fade_time_.has_value()) {
-                    ESP_LOGD(TAG, "Setting fade time: %d", this->fade_time_.value());
-                    this->bus->dali.lamp.setFadeTime(this->address_, this->fade_time_.value());
-                }
-            });
-        }
-        else {
-            ESP_LOGW(TAG, "DALI device at addr %.2x not found!", address_);
-        }
-
-        //bus->dali.dumpStatusForDevice(address_);
+    // Nothing is queried here: LightState publishes the restored state as soon as setup
+    // returns, and the gear is read in the background once the bus task gets to it.
+    // LightState writes the restored level from its first loop(), write_state() queues the
+    // sync behind it. The timeout covers a light that never writes one.
+    if (this->address_ <= ADDR_SHORT_MAX) {
+        this->set_timeout("dali_state_sync", STATE_SYNC_TIMEOUT_MS, [this]() { this->sync_from_bus_(); });
     }
     else {
         // TODO: How do we detect color temperature support for broadcast and group addresses?
     }
 
+    // Defaults until the gear reported its min/max
+    this->build_level_tables_();
+
+    // The restored level is written from the first loop(), the bus batches it with the others
+    if (this->address_ <= ADDR_SHORT_MAX) {
+        bus->expect_restore();
+    }
+
+    // The gear falls back to its system failure level without bus power, put back the last level once it returns
+    bus->add_on_bus_state_callback([this](bool up) {
+        if (!up || this->written_level_ < 0) {
+            return;
+        }
+        uint8_t level = (uint8_t)this->written_level_;
+        if (!bus->restore_level(address_, level)) {
+            bus->dali.lamp.setBrightness(address_, level);
+        }
+        this->verify_write_(level);
+    });
+
+    if (this->has_energy_sensors_()) {
+        this->energy_since_ms_ = millis();
+        this->set_interval("dali_energy", ENERGY_PUBLISH_INTERVAL_MS, [this]() {
+            if (this->gear_energy_) {
+                this->read_gear_energy_();
+            } else {
+                this->publish_energy_();
+            }
+        });
+    }
 
     // if (this->color_mode_.has_value()) {
     //     if (this->color_mode_.value() == DaliColorMode::COLOR_TEMPERATURE) {
@@ -110,6 +90,252 @@ void dali::DaliLight::setup_state(light::LightState *state) {
     // }
 }
 
+void dali::DaliLight::sync_from_bus_() {
+    auto sync = std::make_shared<BusSync>();
+    this->sync_queued_ = true;
+    // A level written after this is newer than what the sync reads
+    uint16_t writes = this->write_count_;
+
+    // The restored levels must be on the bus before the actual level is read
+    this->bus->flush_restore();
+
+    // One job per light, so boot time does not grow with the number of lights on the bus
+    DaliJob* job = new DaliJob;
+    job->run = [this, sync]() {
+        sync->present = this->bus->dali.isDevicePresent(this->address_);
+        if (!sync->present) {
+            return;
+        }
+        sync->min = this->bus->dali.lamp.getMinLevel(this->address_);
+        sync->max = this->bus->dali.lamp.getMaxLevel(this->address_);
+        sync->level = this->bus->dali.lamp.getCurrentLevel(this->address_);
+        sync->status = this->bus->dali.lamp.getStatus(this->address_);
+        if (this->has_energy_sensors_()) {
+            // 16 queries, too slow for the main loop
+            sync->energy = this->bus->dali.memory.readEnergy(this->address_, sync->energy_wh, sync->power_w);
+        }
+
+        // Only writes what differs, queued behind the state queries
+        this->reconcile_config_(*sync);
+    };
+    job->done = [this, sync, writes]() {
+        if (!sync->present) {
+            ESP_LOGW(TAG, "DALI device at addr %.2x not found!", this->address_);
+            return;
+        }
+        ESP_LOGD(TAG, "DALI[%.2x] Is Present", this->address_);
+
+        // Validate query results (0 or 255 typically indicate timeout/error)
+        if (sync->levels_valid()) {
+            if (sync->min != this->dali_level_min_ || sync->max != this->dali_level_max_) {
+                this->dali_level_min_ = sync->min;
+                this->dali_level_max_ = sync->max;
+                this->build_level_tables_();
+            }
+            ESP_LOGD(TAG, "Reported min:%d max:%d", this->dali_level_min_, this->dali_level_max_);
+        } else {
+            ESP_LOGW(TAG, "DALI[%.2x] Invalid query response (min=%d max=%d), keeping defaults", this->address_, sync->min, sync->max);
+        }
+        if (sync->fade_known) {
+            this->dali_fade_time_ = sync->fade_time;
+        }
+
+        // Color temperature support disabled - only brightness mode used
+        // If you need color temp, uncomment and set color_mode: COLOR_TEMPERATURE in YAML
+        // this->tc_supported_ = bus->dali.color.isTcCapable(address_);
+
+        if (this->write_count_ != writes) {
+            ESP_LOGD(TAG, "DALI[%.2x] Level written during the sync, keeping it", this->address_);
+        } else {
+            this->apply_bus_level_(sync->level, (sync->status & STATUS_FADE_STATE) != 0);
+        }
+
+        if (this->has_energy_sensors_()) {
+            this->gear_energy_ = sync->energy;
+            if (this->gear_energy_) {
+                ESP_LOGD(TAG, "DALI[%.2x] Gear reports energy: %.1fWh %.1fW", this->address_, sync->energy_wh, sync->power_w);
+            } else if (this->nominal_power_ <= 0.0f) {
+                ESP_LOGW(TAG, "DALI[%.2x] No energy report from the gear and no nominal_power set", this->address_);
+            }
+        }
+
+        if (sync->writes == 0) {
+            ESP_LOGD(TAG, "DALI[%.2x] Configuration already up to date", this->address_);
+        } else {
+            ESP_LOGD(TAG, "DALI[%.2x] Updated %d setting(s)", this->address_, sync->writes);
+        }
+    };
+    this->bus->run_job(job);
+}
+
+void dali::DaliLight::apply_bus_level_(uint8_t level, bool fading) {
+    if (this->light_state_ == nullptr) {
+        return;
+    }
+
+    // Still fading towards the restored level that was just written, that level wins
+    if (fading && this->written_level_ >= 0) {
+        ESP_LOGD(TAG, "DALI[%.2x] Fading to restored level %d", this->address_, this->written_level_);
+        return;
+    }
+
+    // Accept 0..255 (255 = full brightness on some devices)
+    float brightness = this->brightness_table_[level] / 255.0f;
+    bool on = level > 0;
+
+    bool published_on = this->light_state_->remote_values.is_on();
+    uint8_t published = 0;
+    if (published_on) {
+        published = this->brightness_to_level(this->light_state_->remote_values.get_brightness());
+    }
+    if (published_on == on && (!on || published == level)) {
+        ESP_LOGD(TAG, "DALI[%.2x] Restored state matches the bus (level=%d)", this->address_, level);
+        this->account_level_(level);
+        return;
+    }
+
+    this->light_state_->current_values.set_brightness(brightness);
+    this->light_state_->current_values.set_state(on);
+    this->light_state_->remote_values.set_brightness(brightness);
+    this->light_state_->remote_values.set_state(on);
+    this->light_state_->publish_state();
+
+    ESP_LOGD(TAG, "DALI[%.2x] Synced from bus: level=%d brightness=%.2f", this->address_, level, brightness);
+    this->account_level_(level);
+}
+
+void dali::DaliLight::reconcile_config_(BusSync& sync) {
+    // Every write costs DTR traffic, repeated config frames and an NVM write in the gear,
+    // so read back what the device already has and only send what actually differs.
+    // Runs on the bus task, the main loop only applies the results in sync_from_bus_().
+    uint8_t& writes = sync.writes;
+    const DaliDeviceConfig& config = *this->config_;
+
+    if (config.has(DALI_CONFIG_BRIGHTNESS_CURVE)) {
+        DaliLedDimmingCurve curve = this->bus->dali.led.getDimmingCurve(this->address_);
+        if (curve != config.brightness_curve) {
+            switch (config.brightness_curve) {
+                case DaliLedDimmingCurve::LOGARITHMIC: ESP_LOGD(TAG, "DALI[%.2x] Setting brightness curve to LOGARITHMIC", this->address_); break;
+                case DaliLedDimmingCurve::LINEAR:      ESP_LOGD(TAG, "DALI[%.2x] Setting brightness curve to LINEAR", this->address_); break;
+            }
+            this->bus->dali.led.setDimmingCurve(this->address_, config.brightness_curve);
+            writes++;
+        }
+    }
+
+    // Verification needs to know how long a fade takes
+    if (config.has(DALI_CONFIG_FADE_TIME) || config.has(DALI_CONFIG_FADE_RATE) || this->verify_()) {
+        uint8_t fade = this->bus->dali.lamp.getFadeTimeFadeRate(this->address_);
+        uint8_t fade_time = (fade >> 4) & 0x0F;
+        uint8_t fade_rate = fade & 0x0F;
+        sync.fade_time = fade_time;
+        sync.fade_known = true;
+
+        if (config.has(DALI_CONFIG_FADE_RATE) && fade_rate != config.fade_rate) {
+            ESP_LOGD(TAG, "DALI[%.2x] Setting fade rate: %d (was %d)", this->address_, config.fade_rate, fade_rate);
+            this->bus->dali.lamp.setFadeRate(this->address_, config.fade_rate);
+            writes++;
+        }
+        if (config.has(DALI_CONFIG_FADE_TIME) && fade_time != config.fade_time) {
+            ESP_LOGD(TAG, "DALI[%.2x] Setting fade time: %d (was %d)", this->address_, config.fade_time, fade_time);
+            this->bus->dali.lamp.setFadeTime(this->address_, config.fade_time);
+            sync.fade_time = config.fade_time;
+            writes++;
+        }
+    }
+
+    // Min/max were already queried by sync_from_bus_(), no need to ask again
+    if (config.has(DALI_CONFIG_MIN_LEVEL) && config.min_level != sync.min) {
+        ESP_LOGD(TAG, "DALI[%.2x] Setting min level: %d (was %d)", this->address_, config.min_level, sync.min);
+        this->bus->dali.lamp.setMinLevel(this->address_, config.min_level);
+        sync.min = config.min_level;
+        writes++;
+    }
+    if (config.has(DALI_CONFIG_MAX_LEVEL) && config.max_level != sync.max) {
+        ESP_LOGD(TAG, "DALI[%.2x] Setting max level: %d (was %d)", this->address_, config.max_level, sync.max);
+        this->bus->dali.lamp.setMaxLevel(this->address_, config.max_level);
+        sync.max = config.max_level;
+        writes++;
+    }
+
+    if (config.has(DALI_CONFIG_POWER_ON_LEVEL)) {
+        uint8_t power_on_level = this->bus->dali.lamp.getPowerOnLevel(this->address_);
+        if (power_on_level != config.power_on_level) {
+            ESP_LOGD(TAG, "DALI[%.2x] Setting power-on level: %d (was %d)", this->address_, config.power_on_level, power_on_level);
+            this->bus->dali.lamp.setPowerOnLevel(this->address_, config.power_on_level);
+            writes++;
+        }
+    }
+
+    if (config.has(DALI_CONFIG_GROUPS)) {
+        uint16_t groups = this->bus->dali.scene.getGroups(this->address_);
+        for (uint8_t group = 0; group < 16; group++) {
+            bool member = groups & (1 << group);
+            bool wanted = config.groups & (1 << group);
+            if (member == wanted) {
+                continue;
+            }
+            ESP_LOGD(TAG, "DALI[%.2x] %s group %d", this->address_, wanted ? "Joining" : "Leaving", group);
+            if (wanted) {
+                this->bus->dali.scene.addToGroup(this->address_, group);
+            } else {
+                this->bus->dali.scene.removeFromGroup(this->address_, group);
+            }
+            writes++;
+        }
+    }
+}
+
+void dali::DaliLight::build_level_tables_() {
+    uint8_t min = this->dali_level_min_;
+    uint8_t max = this->dali_level_max_;
+    if (min < 1 || max > 254 || max <= min) {
+        ESP_LOGW(TAG, "DALI[%.2x] Invalid levels (min=%d max=%d), using defaults", this->address_, min, max);
+        min = 1;
+        max = 254;
+    }
+
+    float gamma = 1.0f;
+    if (this->light_state_ != nullptr) {
+        gamma = this->light_state_->get_gamma_correct();
+    }
+
+    bool linear = this->linear_curve_();
+
+    // Work in relative light output, so ESPHome's gamma is applied once and the gear's
+    // own curve maps it back to an arc level. ESPHome brightness spans min..max output.
+    float power_min = linear ? (min / 254.0f) : dali_log_level_to_power(min);
+    float power_max = linear ? (max / 254.0f) : dali_log_level_to_power(max);
+
+    this->level_table_[0] = min;
+    for (int i = 1; i < 256; i++) {
+        float power = power_min + powf(i / 255.0f, gamma) * (power_max - power_min);
+        float level = linear ? (power * 254.0f) : dali_log_power_to_level(power);
+        int rounded = (int)lroundf(level);
+        if (rounded < min) rounded = min;
+        if (rounded > max) rounded = max;
+        this->level_table_[i] = (uint8_t)rounded;
+    }
+
+    // Reverse table: first brightness that produces each level, so that
+    // level -> brightness -> level always returns the same level.
+    // Levels the forward table skips map to the next brightness up.
+    for (int level = 0; level < 256; level++) {
+        this->brightness_table_[level] = 0;
+    }
+    int i = 255;
+    for (int level = 255; level >= 1; level--) {
+        while (i > 1 && this->level_table_[i - 1] >= level) {
+            i--;
+        }
+        this->brightness_table_[level] = (uint8_t)i;
+    }
+    this->brightness_table_[255] = 255; // MASK: full brightness on some devices
+
+    ESP_LOGD(TAG, "DALI[%.2x] Level table: min=%d max=%d gamma=%.1f curve=%s",
+        this->address_, min, max, gamma, linear ? "LINEAR" : "LOGARITHMIC");
+}
+
 light::LightTraits dali::DaliLight::get_traits() {
     light::LightTraits traits;
 
@@ -158,28 +384,269 @@ void dali::DaliLight::write_state(light::LightState *state) {
     state->current_values_as_binary(&on);
     if (!on) {
         // User turned light OFF - send with fade
-        bus->dali.lamp.setBrightness(address_, 0);
+        if (!bus->restore_level(address_, 0)) {
+            bus->dali.lamp.setBrightness(address_, 0);
+        }
+        this->written_level_ = 0;
+        this->written_();
+        this->verify_write_(0);
+        this->account_level_(0);
         return;
     }
 
-    // Brightness-only mode
-    state->current_values_as_brightness(&brightness);
+    // Brightness-only mode. Use the raw brightness, gamma is already folded into the level table.
+    brightness = state->current_values.get_brightness();
+    uint8_t dali_brightness = this->brightness_to_level(brightness);
 
-    // Safety: use defaults if member variables are corrupted
-    float range = this->dali_level_range_;
-    uint8_t min = this->dali_level_min_;
-    uint8_t max = this->dali_level_max_;
-    if (range <= 0.0f || min < 1 || min > 254 || max < 1 || max > 254 || max <= min) {
-      ESP_LOGW(TAG, "DALI[%d] Corrupted values (range=%.0f min=%d max=%d), using defaults", address_, range, min, max);
-      range = 254.0f;
-      min = 1;
-      max = 254;
+    ESP_LOGD(TAG, "DALI[%d] B=%.2f (%d)", address_, brightness, dali_brightness);
+    // Levels restored during boot are sent together by the bus
+    if (!bus->restore_level(address_, dali_brightness)) {
+        bus->dali.lamp.setBrightness(address_, dali_brightness);
+    }
+    this->written_level_ = dali_brightness;
+    this->written_();
+    this->verify_write_(dali_brightness);
+    this->account_level_(dali_brightness);
+}
+
+void dali::DaliLight::written_() {
+    this->write_count_++;
+    if (this->sync_queued_ || this->address_ > ADDR_SHORT_MAX) {
+        return;
+    }
+    // The first write is the restored level. Deferred to the next loop, by then every light
+    // has written its level and the bus has sent them, so the sync reads the restored level.
+    this->sync_queued_ = true;
+    this->cancel_timeout("dali_state_sync");
+    this->defer("dali_state_sync", [this]() { this->sync_from_bus_(); });
+}
+
+bool dali::DaliLight::has_energy_sensors_() const {
+#ifdef USE_SENSOR
+    return this->power_sensor_ != nullptr || this->energy_sensor_ != nullptr;
+#else
+    return false;
+#endif
+}
+
+void dali::DaliLight::account_level_(uint8_t level) {
+    if (!this->has_energy_sensors_() || this->gear_energy_ || this->nominal_power_ <= 0.0f) {
+        return;
     }
 
-    int dali_brightness = static_cast<uint8_t>(brightness * range) + min - 1;
-    if (dali_brightness < 1) dali_brightness = 1;
-    if (dali_brightness > 254) dali_brightness = 254;
+    // The level is clamped by the gear, 0 is off and 255 (MASK) keeps the previous level
+    if (level == 255) {
+        return;
+    }
+    if (level != 0) {
+        if (level < this->dali_level_min_) level = this->dali_level_min_;
+        if (level > this->dali_level_max_) level = this->dali_level_max_;
+    }
+
+    bool linear = this->linear_curve_();
+    float output = 0.0f;
+    if (level != 0) {
+        output = linear ? (level / 254.0f) : dali_log_level_to_power(level);
+    }
+
+    uint32_t now = millis();
+    this->energy_wh_ += this->power_w_ * (double)(now - this->energy_since_ms_) / 3600000.0;
+    this->energy_since_ms_ = now;
+
+    float power = this->nominal_power_ * output;
+    if (power == this->power_w_) {
+        return;
+    }
+    this->power_w_ = power;
+
+#ifdef USE_SENSOR
+    if (this->power_sensor_ != nullptr) {
+        this->power_sensor_->publish_state(power);
+    }
+    if (this->energy_sensor_ != nullptr) {
+        this->energy_sensor_->publish_state(this->energy_wh_);
+    }
+#endif
+}
+
+void dali::DaliLight::publish_energy_() {
+    if (this->nominal_power_ <= 0.0f) {
+        return;
+    }
+
+#ifdef USE_SENSOR
+    // Energy of the running interval, without closing it
+    double energy = this->energy_wh_ + this->power_w_ * (double)(millis() - this->energy_since_ms_) / 3600000.0;
+    if (this->energy_sensor_ != nullptr) {
+        this->energy_sensor_->publish_state(energy);
+    }
+    if (this->power_sensor_ != nullptr && !this->power_sensor_->has_state()) {
+        this->power_sensor_->publish_state(this->power_w_);
+    }
+#endif
+}
+
+void dali::DaliLight::read_gear_energy_() {
+    struct Reading {
+        bool valid = false;
+        float energy_wh = 0.0f;
+        float power_w = 0.0f;
+    };
+    auto reading = std::make_shared<Reading>();
+
+    // DTR0/DTR1 must not be touched by anything else while the bank is read
+    DaliJob* job = new DaliJob;
+    job->run = [this, reading]() {
+        reading->valid = this->bus->dali.memory.readEnergy(this->address_, reading->energy_wh, reading->power_w);
+    };
+    job->done = [this, reading]() {
+        if (!reading->valid) {
+            ESP_LOGW(TAG, "DALI[%.2x] Energy report could not be read", this->address_);
+            return;
+        }
+#ifdef USE_SENSOR
+        if (this->power_sensor_ != nullptr) {
+            this->power_sensor_->publish_state(reading->power_w);
+        }
+        if (this->energy_sensor_ != nullptr) {
+            this->energy_sensor_->publish_state(reading->energy_wh);
+        }
+#endif
+    };
+    this->bus->run_job(job);
+}
+
+uint8_t dali::DaliLight::brightness_to_level(float brightness) const {
+    int index = (int)lroundf(brightness * 255.0f);
+    if (index < 0) index = 0;
+    if (index > 255) index = 255;
+    return this->level_table_[index];
+}
+
+void dali::DaliLight::begin_effect(uint8_t fade_time, uint8_t fade_rate) {
+    // Switching effects: the next one starts from the fade of the previous one, and only
+    // what differs is written. Every fade write is an NVM write in the gear.
+    this->cancel_timeout("dali_effect_end");
+
+    DaliJob* job = new DaliJob;
+    job->run = [this, fade_time, fade_rate]() {
+        if (!this->effect_session_) {
+            // Groups can not be queried, assume they use the YAML values or the DALI defaults
+            uint8_t saved;
+            if (this->address_ <= ADDR_SHORT_MAX) {
+                saved = this->bus->dali.lamp.getFadeTimeFadeRate(this->address_);
+            } else {
+                saved = (this->config_->has(DALI_CONFIG_FADE_TIME) ? this->config_->fade_time : 0) << 4;
+                saved |= this->config_->has(DALI_CONFIG_FADE_RATE) ? this->config_->fade_rate : 7;
+            }
+            this->effect_saved_fade_ = saved;
+            this->effect_fade_ = saved;
+            this->effect_session_ = true;
+        }
+
+        // An effect that leaves a value gets the one from before the session
+        uint8_t saved = this->effect_saved_fade_;
+        uint8_t time = fade_time <= 15 ? fade_time : (saved >> 4);
+        uint8_t rate = fade_rate <= 15 ? fade_rate : (saved & 0x0F);
+        if (time != (this->effect_fade_ >> 4)) {
+            this->bus->dali.lamp.setFadeTime(this->address_, time);
+        }
+        if (rate != (this->effect_fade_ & 0x0F)) {
+            this->bus->dali.lamp.setFadeRate(this->address_, rate);
+        }
+        this->effect_fade_ = (time << 4) | rate;
+    };
+    this->bus->run_job(job);
+}
+
+void dali::DaliLight::end_effect() {
+    // LightState stops the old effect right before it starts a new one, begin_effect() cancels this
+    this->set_timeout("dali_effect_end", 0, [this]() {
+        // Queued behind begin_effect(), so the saved values are known by the time this runs
+        DaliJob* job = new DaliJob;
+        job->run = [this]() {
+            uint8_t saved = this->effect_saved_fade_;
+            if ((this->effect_fade_ & 0xF0) != (saved & 0xF0)) {
+                this->bus->dali.lamp.setFadeTime(this->address_, saved >> 4);
+            }
+            if ((this->effect_fade_ & 0x0F) != (saved & 0x0F)) {
+                this->bus->dali.lamp.setFadeRate(this->address_, saved & 0x0F);
+            }
+            this->effect_fade_ = saved;
+            this->effect_session_ = false;
+        };
+        this->bus->run_job(job);
+    });
+}
+
+void dali::DaliLight::start_dim(bool up, bool step) {
+    // A pending level check would undo the dimming
+    this->bus->cancel_verify(this->address_);
+    this->cancel_interval("dali_dim");
+
+    auto& lamp = this->bus->dali.lamp;
+    if (up && this->light_state_ != nullptr && !this->light_state_->remote_values.is_on()) {
+        // UP does not switch a lamp on
+        lamp.onAndStepUp(this->address_);
+    }
+
+    this->dimming_ = true;
+    this->dimming_step_ = step;
+    if (!step) {
+        if (up) {
+            lamp.continuousUp(this->address_);
+        } else {
+            lamp.continuousDown(this->address_);
+        }
+        return;
+    }
+
+    // UP/DOWN fade for 200 ms, repeat them until the button is released
+    auto dim = [this, up]() {
+        if (up) {
+            this->bus->dali.lamp.fadeUp(this->address_);
+        } else {
+            this->bus->dali.lamp.fadeDown(this->address_);
+        }
+    };
+    dim();
+    this->set_interval("dali_dim", DIM_STEP_MS, dim);
+}
+
+void dali::DaliLight::stop_dim() {
+    if (!this->dimming_) {
+        return;
+    }
+    this->dimming_ = false;
+
+    if (this->dimming_step_) {
+        this->cancel_interval("dali_dim");
+    } else {
+        this->bus->dali.lamp.stopFade(this->address_);
+    }
+
+    // Groups can not be queried, their state stays as it was published
+    if (this->address_ > ADDR_SHORT_MAX) {
+        return;
+    }
+    this->bus->dali.queryAsync(this->address_, DaliCommand::QUERY_ACTUAL_LEVEL, [this](uint8_t level) {
+        ESP_LOGD(TAG, "DALI[%.2x] Dimmed to level %d", this->address_, level);
+        this->written_level_ = level;
+        this->apply_bus_level_(level, false);
+    });
+}
+
+void dali::DaliLight::verify_write_(uint8_t level) {
+    if (!this->verify_() || this->address_ > ADDR_SHORT_MAX) {
+        return;
+    }
+
+    // The gear clamps DAPC levels to its min/max
+    uint8_t expected = level;
+    if (level != 0) {
+        if (expected < this->dali_level_min_) expected = this->dali_level_min_;
+        if (expected > this->dali_level_max_) expected = this->dali_level_max_;
+    }
 
-    ESP_LOGD(TAG, "DALI[%d] B=%.2f (%d) range=%.0f min=%d max=%d", address_, brightness, dali_brightness, range, min, max);
-    bus->dali.lamp.setBrightness(address_, (uint8_t)dali_brightness);
+    this->bus->verify_level(this->address_, level, expected, dali_fade_time_ms(this->dali_fade_time_) + VERIFY_MARGIN_MS);
 }
@@ -2,11 +2,21 @@
 
 #include <esphome.h>
 #include "esphome/components/light/light_output.h"
+#include "esphome/components/light/light_state.h"
 #include "esphome_dali.h"
+#include "esphome_dali_effects.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
 
 namespace esphome {
 namespace dali {
 
+/// @brief Fade time T = 0.5 * sqrt(2^n) seconds, 0 = no fade
+inline uint32_t dali_fade_time_ms(uint8_t fade_time) {
+    return fade_time == 0 ? 0 : (uint32_t)(500.0f * sqrtf((float)(1u << fade_time)));
+}
+
 enum class DaliColorMode {
     AUTO,
     ON_OFF,
@@ -19,8 +29,6 @@ class DaliLight : public light::LightOutput, public Component {
     DaliLight(DaliBusComponent* parent)
         : bus(parent)
         , address_(ADDR_BROADCAST)
-        , fade_time_()
-        , fade_rate_()
         , cold_white_temperature_(100.0f) // 10000K
         , warm_white_temperature_(370.0f) // 2700K
         , tc_supported_(false)
@@ -28,9 +36,7 @@ class DaliLight : public light::LightOutput, public Component {
         , dali_tc_warmest_(400.0f)
         , dali_level_min_(1)
         , dali_level_max_(254)
-        , dali_level_range_(254.0f)
         , color_mode_()
-        , brightness_curve_()
         , light_state_(nullptr)
     { }
 
@@ -39,24 +45,45 @@ class DaliLight : public light::LightOutput, public Component {
     void setup_state(light::LightState *state) override;
     void write_state(light::LightState *state) override;
 
-    void set_address(uint8_t address) { 
-        address_ = address; 
-
-        // Prevent dynamic creation of lights with this address
-        // (when device discovery is enabled)
-        if (this->address_ <= ADDR_SHORT_MAX) {
-            bus->register_static_addr(address_);
-        }
+    /// @brief Address and gear settings, from the codegen device table or a discovery slot
+    void set_config(const DaliDeviceConfig* config) {
+        config_ = config;
+        address_ = config->address;
     }
 
     void set_cold_white_temperature(float cold_white_temperature) { cold_white_temperature_ = cold_white_temperature; }
     void set_warm_white_temperature(float warm_white_temperature) { warm_white_temperature_ = warm_white_temperature; }
 
     void set_color_mode(DaliColorMode color_mode) { color_mode_ = color_mode; }
-    void set_brightness_curve(DaliLedDimmingCurve brightness_curve) { brightness_curve_ = brightness_curve; }
 
-    void set_fade_time(uint16_t fade_time) { fade_time_ = fade_time; }
-    void set_fade_rate(uint16_t fade_rate) { fade_rate_ = fade_rate; }
+    /// @brief Power drawn at full output, power and energy are estimated from the level with it
+    void set_nominal_power(float nominal_power) { nominal_power_ = nominal_power; }
+#ifdef USE_SENSOR
+    void set_power_sensor(sensor::Sensor* power_sensor) { power_sensor_ = power_sensor; }
+    void set_energy_sensor(sensor::Sensor* energy_sensor) { energy_sensor_ = energy_sensor; }
+#endif
+
+    DaliBusComponent* get_bus() const { return bus; }
+    short_addr_t get_address() const { return address_; }
+    uint8_t get_min_level() const { return dali_level_min_; }
+    uint8_t get_max_level() const { return dali_level_max_; }
+    /// @brief ESPHome brightness (0..1, before gamma) -> DALI arc level
+    uint8_t brightness_to_level(float brightness) const;
+
+    /// @brief Switch the gear to the fade time and/or rate an effect needs, remembering the current ones
+    /// @param fade_time 0..15, or 0xFF to leave it
+    /// @param fade_rate 1..15, or 0xFF to leave it
+    void begin_effect(uint8_t fade_time, uint8_t fade_rate);
+    /// @brief Put back the fade time and rate replaced by begin_effect(), unless another effect
+    /// starts in the same loop
+    void end_effect();
+
+    /// @brief Start dimming while a button is held, the gear fades on its own until stop_dim()
+    /// @param up Direction, dimming up from off starts at the min level
+    /// @param step Repeat UP/DOWN (200 ms fades) instead of CONTINUOUS_UP/DOWN, for gear without DALI-2
+    void start_dim(bool up, bool step);
+    /// @brief Stop dimming and publish the level the gear stopped at
+    void stop_dim();
 
     // NOTE: Must have a lower priority number than the DALI bus component
     float get_setup_priority() const override { return setup_priority::DATA; }
@@ -65,8 +92,9 @@ class DaliLight : public light::LightOutput, public Component {
     DaliBusComponent *bus;
 
     uint8_t address_;
-    optional<uint16_t> fade_time_;
-    optional<uint16_t> fade_rate_;
+    const DaliDeviceConfig* config_ = nullptr;
+    /// @brief Fade time code of the gear, used to time verification
+    uint8_t dali_fade_time_ = 0;
 
     float cold_white_temperature_;
     float warm_white_temperature_;
@@ -74,13 +102,103 @@ class DaliLight : public light::LightOutput, public Component {
     float dali_tc_warmest_;
     uint8_t dali_level_min_;
     uint8_t dali_level_max_;
-    float dali_level_range_;
     optional<DaliColorMode> color_mode_;
-    optional<DaliLedDimmingCurve> brightness_curve_;
 
     bool tc_supported_;
     light::LightState *light_state_;
-    
+
+    /// @brief State read from the gear by sync_from_bus_() on the bus task
+    struct BusSync {
+        bool present = false;
+        uint8_t min = 0;
+        uint8_t max = 0;
+        uint8_t level = 0;
+        uint8_t status = 0;
+        bool energy = false;
+        float energy_wh = 0.0f;
+        float power_w = 0.0f;
+        bool fade_known = false;
+        uint8_t fade_time = 0;
+        uint8_t writes = 0;
+
+        bool levels_valid() const { return min >= 1 && min <= 254 && max >= 1 && max <= 254 && max > min; }
+    };
+
+    /// @brief Read min/max and the actual level on the bus task, without holding up setup
+    void sync_from_bus_();
+    /// @brief Republish with the gear level, only if it differs from the restored state
+    void apply_bus_level_(uint8_t level, bool fading);
+    bool dimming_ = false;
+    bool dimming_step_ = false;
+
+    /// @brief Fade time << 4 | fade rate before and during an effect, bus task only
+    uint8_t effect_saved_fade_ = 0;
+    uint8_t effect_fade_ = 0;
+    /// @brief Effects have replaced the fade, it is put back once the last one stopped
+    bool effect_session_ = false;
+
+    /// @brief Last arc level sent by write_state(), -1 before the first write
+    int16_t written_level_ = -1;
+    /// @brief Number of write_state() calls, a sync does not republish over a newer write
+    uint16_t write_count_ = 0;
+    bool sync_queued_ = false;
+    /// @brief After every write_state(), queues the state sync behind the first one
+    void written_();
+
+    /// @brief Bus task. Read the device configuration once and only write settings that differ from YAML
+    void reconcile_config_(BusSync& sync);
+
+    /// @brief Read back the level after every write and resend it if the gear did not apply it
+    bool verify_() const { return this->config_->has(DALI_CONFIG_VERIFY); }
+    bool linear_curve_() const {
+        return this->config_->has(DALI_CONFIG_BRIGHTNESS_CURVE) &&
+            this->config_->brightness_curve == DaliLedDimmingCurve::LINEAR;
+    }
+
+    /// @brief Queue a read back of a level write when verify is enabled
+    void verify_write_(uint8_t level);
+
+    float nominal_power_ = 0.0f;
+#ifdef USE_SENSOR
+    sensor::Sensor* power_sensor_ = nullptr;
+    sensor::Sensor* energy_sensor_ = nullptr;
+#endif
+    /// @brief Estimated power at the last written level
+    float power_w_ = 0.0f;
+    /// @brief Estimated energy up to energy_since_ms_
+    double energy_wh_ = 0.0;
+    uint32_t energy_since_ms_ = 0;
+    /// @brief The gear reports its own energy (IEC 62386-252), estimates are not used
+    bool gear_energy_ = false;
+
+    bool has_energy_sensors_() const;
+    /// @brief Close the energy interval at the old level and start one at the new level
+    void account_level_(uint8_t level);
+    void publish_energy_();
+    /// @brief Read the energy report of the gear on the bus task and publish it
+    void read_gear_energy_();
+
+    /// @brief Rebuild the level tables from min/max, dimming curve and gamma
+    void build_level_tables_();
+
+    /// @brief ESPHome brightness (0..255, before gamma) -> DALI arc level
+    uint8_t level_table_[256];
+    /// @brief DALI arc level -> ESPHome brightness (0..255, before gamma)
+    uint8_t brightness_table_[256];
+};
+
+/// @brief Storage for one light created by discovery. The pool is emitted by codegen,
+/// lights are constructed in place so discovery does not touch the heap.
+struct DaliLightSlot {
+    DaliDeviceConfig config;
+    alignas(DaliLight) uint8_t light[sizeof(DaliLight)];
+    alignas(light::LightState) uint8_t state[sizeof(light::LightState)];
+    alignas(DaliPulseEffect) uint8_t pulse[sizeof(DaliPulseEffect)];
+    alignas(DaliBreatheEffect) uint8_t breathe[sizeof(DaliBreatheEffect)];
+    alignas(DaliWakeUpEffect) uint8_t wake_up[sizeof(DaliWakeUpEffect)];
+    alignas(DaliIdentifyEffect) uint8_t identify[sizeof(DaliIdentifyEffect)];
+    char name[20];
+    char object_id[28];
 };
 
 }  // namespace dali
@@ -0,0 +1,748 @@
+#include <esphome.h>
+#include <esp_timer.h>
+#include "esphome_dali_scheduler.h"
+#include "esphome_dali.h"
+
+using namespace esphome;
+using namespace dali;
+
+// A half-bit at 1200 baud is 416.67us. Deadlines are measured from the start of
+// the frame, so rounding does not accumulate over the 34 half-bits of a frame,
+// and the cost of writing several pins is absorbed instead of added.
+#define HALF_BIT_DEADLINE_US(k) (((int64_t)(k) * 1250) / 3)
+
+// Backward frame bits are sampled in the first half of each bit, moved per bus by the measured loopback delays.
+#define SAMPLE_OFFSET_US (BIT_PERIOD + QUARTER_BIT_PERIOD)
+
+// Interrupts are only masked for the last few microseconds before an edge or a sample is due
+#define LOCK_WINDOW_US (20)
+
+// The loopback correction of the sample point is an estimate, the transmitter's share of
+// the delays can not be told apart, so it is kept within an eighth of a bit
+#define SAMPLE_SKEW_MAX_US (QUARTER_BIT_PERIOD / 2)
+
+// Longer than this between two samples and a line is no longer considered watched
+#define WATCH_GAP_US (100)
+
+// Settling time windows per priority, IEC 62386-101 multi-master timing
+static const uint32_t DALI_PRIORITY_SETTLING_US[5][2] = {
+    { 13500, 14700 },
+    { 14900, 16100 },
+    { 16300, 17700 },
+    { 17900, 19300 },
+    { 19500, 21100 },
+};
+
+// Spin with interrupts enabled until the masked part of a wait for due_us starts
+static inline void approach_(int64_t due_us) {
+    while (esp_timer_get_time() < due_us - LOCK_WINDOW_US) { }
+}
+
+DaliBusScheduler& DaliBusScheduler::instance() {
+    static DaliBusScheduler scheduler;
+    return scheduler;
+}
+
+void DaliBusScheduler::register_bus(DaliBusComponent* bus) {
+    size_t count = bus_count_.load(std::memory_order_relaxed);
+    if (count >= DALI_MAX_BUSES) {
+        DALI_LOGE("Too many DALI buses, at most %d are supported", DALI_MAX_BUSES);
+        return;
+    }
+    buses_[count] = bus;
+    bus_count_.store(count + 1, std::memory_order_release);
+
+    if (task_ == nullptr) {
+        xTaskCreatePinnedToCore(task_entry_, "dali", DALI_TASK_STACK_SIZE, this,
+            DALI_TASK_PRIORITY, &task_, DALI_TASK_CORE);
+        DALI_LOGD("DALI bus task started on core %d", DALI_TASK_CORE);
+    }
+}
+
+void DaliBusScheduler::notify() {
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void IRAM_ATTR DaliBusScheduler::notify_from_isr() {
+    if (task_ != nullptr) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task_, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void DaliBusScheduler::task_entry_(void* arg) {
+    static_cast<DaliBusScheduler*>(arg)->run_();
+}
+
+void DaliBusScheduler::run_() {
+    busy_since_ = esp_timer_get_time();
+    for (;;) {
+        bool worked = run_jobs_();
+        worked |= run_frames_();
+        bool listening = run_monitor_();
+        check_lines_();
+        if (!worked) {
+            // Nothing queued on any bus, sleep until a producer pushes something.
+            // A monitored frame in progress is only finished by the line going idle, so poll for that.
+            // Otherwise wake up now and then to see if a line lost its bus power.
+            ulTaskNotifyTake(pdTRUE, listening ? DALI_MONITOR_POLL_TICKS : DALI_LINE_POLL_TICKS);
+            busy_since_ = esp_timer_get_time();
+        }
+    }
+}
+
+void DaliBusScheduler::yield_if_busy_() {
+    // Long jobs like discovery would otherwise keep lower priority tasks off this core
+    if (esp_timer_get_time() - busy_since_ > DALI_TASK_MAX_BUSY_US) {
+        vTaskDelay(1);
+        busy_since_ = esp_timer_get_time();
+    }
+}
+
+bool DaliBusScheduler::run_jobs_() {
+    bool worked = false;
+    size_t count = bus_count();
+    for (size_t i = 0; i < count; i++) {
+        DaliBusComponent* bus = buses_[i];
+        DaliTransaction* t = bus->m_commands.peek();
+        if (t == nullptr || t->type != DaliTransactionType::JOB) {
+            continue;
+        }
+
+        // Jobs get their bus to themselves, the other lines wait until it returns
+        DaliTransaction job = *t;
+        job.job->run();
+        bus->m_commands.pop();
+        complete_(bus, job.tag, 0, job.job);
+        worked = true;
+    }
+    return worked;
+}
+
+bool DaliBusScheduler::run_frames_() {
+    DaliBusComponent* batch[DALI_MAX_BUSES];
+    DaliTransaction items[DALI_MAX_BUSES];
+    size_t count = 0;
+
+    DaliBusComponent* tx_buses[DALI_MAX_BUSES];
+    uint32_t tx_frames[DALI_MAX_BUSES];
+    uint8_t tx_lengths[DALI_MAX_BUSES];
+    bool tx_sent[DALI_MAX_BUSES];
+    size_t tx_count = 0;
+
+    DaliBusComponent* rx_buses[DALI_MAX_BUSES];
+    uint8_t rx_timeouts[DALI_MAX_BUSES];
+    uint8_t rx_replies[DALI_MAX_BUSES];
+    bool rx_received[DALI_MAX_BUSES];
+    size_t rx_count = 0;
+
+    // A frame that must be sent twice has its repeat sent right after it. Listening for a
+    // reply on another line would push the repeat out of the 100 ms window, so queries
+    // wait for the next round.
+    size_t buses = bus_count();
+    bool repeat_round = false;
+    for (size_t i = 0; i < buses; i++) {
+        DaliTransaction* t = buses_[i]->m_commands.peek();
+        if (t != nullptr && t->type == DaliTransactionType::FORWARD && t->twice) {
+            repeat_round = true;
+        }
+    }
+
+    // Take the next frame from every bus that has one
+    for (size_t i = 0; i < buses; i++) {
+        DaliBusComponent* bus = buses_[i];
+        DaliTransaction* t = bus->m_commands.peek();
+        if (t == nullptr || t->type == DaliTransactionType::JOB) {
+            continue;
+        }
+        if (repeat_round && t->type != DaliTransactionType::FORWARD) {
+            continue;
+        }
+
+        batch[count] = bus;
+        items[count] = *t;
+        count++;
+
+        if (t->type != DaliTransactionType::RECEIVE) {
+            tx_buses[tx_count] = bus;
+            tx_frames[tx_count] = t->frame();
+            tx_lengths[tx_count] = t->length;
+            tx_count++;
+        }
+    }
+
+    if (count == 0) {
+        return false;
+    }
+
+    if (tx_count > 0) {
+        transmit_concurrent_(tx_buses, tx_frames, tx_lengths, tx_sent, tx_count);
+    }
+
+    if (repeat_round) {
+        // The lines were watched since the first frame ended, so its stop bits already
+        // count towards the settling time of the repeat.
+        DaliBusComponent* repeat_buses[DALI_MAX_BUSES];
+        uint32_t repeat_frames[DALI_MAX_BUSES];
+        uint8_t repeat_lengths[DALI_MAX_BUSES];
+        bool repeat_sent[DALI_MAX_BUSES];
+        size_t repeat_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            // A lone repeat has no effect, skip it if the first frame was lost
+            if (items[i].twice && tx_sent[i]) {
+                repeat_buses[repeat_count] = batch[i];
+                repeat_frames[repeat_count] = tx_frames[i];
+                repeat_lengths[repeat_count] = tx_lengths[i];
+                repeat_count++;
+            }
+        }
+        if (repeat_count > 0) {
+            // The second frame of a transaction goes in the priority 1 window
+            transmit_concurrent_(repeat_buses, repeat_frames, repeat_lengths, repeat_sent, repeat_count, DALI_REPEAT_PRIORITY);
+        }
+    }
+
+    // Only listen for replies to queries that actually made it onto the bus
+    bool listen[DALI_MAX_BUSES];
+    size_t tx_index = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool sent = items[i].type == DaliTransactionType::RECEIVE || tx_sent[tx_index++];
+        listen[i] = sent && items[i].type != DaliTransactionType::FORWARD;
+        if (listen[i]) {
+            rx_buses[rx_count] = batch[i];
+            rx_timeouts[rx_count] = items[i].timeout_ms;
+            rx_count++;
+        }
+    }
+    if (rx_count > 0) {
+        receive_concurrent_(rx_buses, rx_timeouts, rx_replies, rx_received, rx_count);
+    }
+
+    size_t rx_index = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t reply = 0;
+        bool received = false;
+        if (listen[i]) {
+            reply = rx_replies[rx_index];
+            received = rx_received[rx_index];
+            rx_index++;
+        }
+        batch[i]->m_commands.pop();
+        complete_(batch[i], items[i].tag, reply, nullptr, received);
+    }
+
+    yield_if_busy_();
+    return true;
+}
+
+void DaliBusScheduler::complete_(DaliBusComponent* bus, uint32_t tag, uint8_t reply, DaliJob* job, bool received) {
+    if (tag == 0 && job == nullptr) {
+        return;
+    }
+
+    DaliCompletion completion { tag, reply, job, received };
+    while (!bus->m_completions.push(completion)) {
+        // Main loop is behind, give it a chance to drain the ring
+        vTaskDelay(1);
+    }
+
+    TaskHandle_t waiter = bus->m_waiter.load(std::memory_order_acquire);
+    if (waiter != nullptr) {
+        xTaskNotifyGive(waiter);
+    }
+}
+
+bool DaliBusScheduler::run_monitor_() {
+    bool listening = false;
+    size_t count = bus_count();
+    for (size_t i = 0; i < count; i++) {
+        DaliBusComponent* bus = buses_[i];
+        if (bus->m_monitorEdges == nullptr || bus->m_monitorPaused.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        DaliFrameDecoder& decoder = bus->m_monitorDecoder;
+        DaliFrameRecord frame;
+        uint32_t start;
+        DaliEdge edge;
+        while (bus->m_monitorEdges->pop(edge)) {
+            if (decoder.edge(edge, start, frame)) {
+                // Edges carry the low 32 bits of the esp_timer clock
+                int64_t now = esp_timer_get_time();
+                frame.time_us = now - (uint32_t)((uint32_t)now - start);
+                record_frame_(bus, frame);
+            }
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (decoder.idle((uint32_t)now, start, frame)) {
+            frame.time_us = now - (uint32_t)((uint32_t)now - start);
+            record_frame_(bus, frame);
+        }
+        listening |= decoder.inFrame();
+    }
+    return listening;
+}
+
+void DaliBusScheduler::pause_monitor_(DaliBusComponent* bus) {
+    if (bus->m_monitorEdges != nullptr) {
+        bus->m_monitorPaused.store(true, std::memory_order_release);
+    }
+}
+
+void DaliBusScheduler::resume_monitor_(DaliBusComponent* bus) {
+    if (bus->m_monitorEdges == nullptr) {
+        return;
+    }
+
+    // Edges seen while paused were our own frame, start over with an empty ring
+    DaliEdge edge;
+    while (bus->m_monitorEdges->pop(edge)) { }
+    bus->m_monitorDecoder.reset();
+    bus->m_monitorPaused.store(false, std::memory_order_release);
+}
+
+void DaliBusScheduler::record_frame_(DaliBusComponent* bus, const DaliFrameRecord& frame) {
+    if (bus->m_monitorFrames == nullptr) {
+        return;
+    }
+    if (frame.source != DaliFrameSource::BUS && !bus->m_monitor) {
+        // Only listening for input device events
+        return;
+    }
+    if (!bus->m_monitorFrames->push(frame)) {
+        // Logger is behind, never stall the bus for it
+        bus->m_monitorDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool DaliBusScheduler::transmit(DaliBusComponent* bus, uint32_t frame, uint8_t length) {
+    bool sent;
+    transmit_concurrent_(&bus, &frame, &length, &sent, 1);
+    yield_if_busy_();
+    return sent;
+}
+
+bool DaliBusScheduler::transmit_twice(DaliBusComponent* bus, uint32_t frame, uint8_t length) {
+    bool sent;
+    transmit_concurrent_(&bus, &frame, &length, &sent, 1);
+    if (sent) {
+        transmit_concurrent_(&bus, &frame, &length, &sent, 1, DALI_REPEAT_PRIORITY);
+    }
+    yield_if_busy_();
+    return sent;
+}
+
+uint8_t DaliBusScheduler::receive(DaliBusComponent* bus, unsigned long timeout_ms, bool* received) {
+    uint8_t timeout = timeout_ms > 255 ? 255 : (uint8_t)timeout_ms;
+    uint8_t reply = 0;
+    bool answered = false;
+    receive_concurrent_(&bus, &timeout, &reply, &answered, 1);
+    yield_if_busy_();
+    if (received != nullptr) {
+        *received = answered;
+    }
+    return reply;
+}
+
+void DaliBusScheduler::calibrate(DaliBusComponent* bus) {
+    // The esp_timer read and pin write costs are sub-microsecond, below the resolution of the
+    // deadlines, and they delay every edge alike. The dry run measures them as part of each half-bit.
+    DaliBitTiming& timing = bus->m_timing;
+
+    // Same deadlines and pin writes as transmit_frame_() for a 16 bit frame
+    int64_t written[2 * 17 + 1];
+    int64_t start = esp_timer_get_time() + LOCK_WINDOW_US;
+    for (int half = 0; half <= 2 * 17; half++) {
+        int64_t due = start + HALF_BIT_DEADLINE_US(half);
+        approach_(due);
+        InterruptLock lock;
+        while (esp_timer_get_time() < due) { }
+        bus->m_txPin->digital_write(false);
+        written[half] = esp_timer_get_time();
+    }
+
+    int64_t shortest = INT64_MAX;
+    int64_t longest = 0;
+    for (int half = 1; half <= 2 * 17; half++) {
+        int64_t length = written[half] - written[half - 1];
+        if (length < shortest) shortest = length;
+        if (length > longest) longest = length;
+    }
+    timing.half_bit_min_us = (uint16_t)shortest;
+    timing.half_bit_max_us = (uint16_t)longest;
+    yield_if_busy_();
+}
+
+int32_t DaliBusScheduler::sample_offset_us(const DaliBusComponent* bus) {
+    uint32_t loopback = bus->m_loopback.load(std::memory_order_relaxed);
+    if (loopback == 0) {
+        return SAMPLE_OFFSET_US;
+    }
+
+    // The start of a reply is seen late by the active delay, the end of each active half
+    // late by the idle delay. Move the sample to the middle of what RX sees.
+    int32_t skew = ((int32_t)(loopback & 0xFFFF) - (int32_t)(loopback >> 16)) / 2;
+    if (skew > SAMPLE_SKEW_MAX_US) skew = SAMPLE_SKEW_MAX_US;
+    if (skew < -SAMPLE_SKEW_MAX_US) skew = -SAMPLE_SKEW_MAX_US;
+    return SAMPLE_OFFSET_US + skew;
+}
+
+void DaliBusScheduler::watch_line_(DaliBusComponent* bus, int64_t now) {
+    if (now - bus->m_watchedAt > WATCH_GAP_US) {
+        // We were not looking, nothing is known about the line before now
+        bus->m_idleSince = now;
+    }
+    bool active = bus->m_rxPin->digital_read();
+    if (active) {
+        bus->m_idleSince = now;
+    }
+    bus->m_watchedAt = now;
+
+    // No frame keeps the line active for more than a bit, so a line that reads active on every
+    // sample for DALI_BUS_DOWN_US is down. Samples are at most DALI_LINE_POLL_TICKS apart.
+    if (active != bus->m_lineActive) {
+        bus->m_lineActive = active;
+        bus->m_lineChangedAt = now;
+    }
+    bool down = bus->m_busDown.load(std::memory_order_relaxed);
+    if (active != down && now - bus->m_lineChangedAt >= (down ? DALI_BUS_UP_US : DALI_BUS_DOWN_US)) {
+        bus->m_busDown.store(active, std::memory_order_release);
+    }
+}
+
+void DaliBusScheduler::check_lines_() {
+    int64_t now = esp_timer_get_time();
+    size_t count = bus_count();
+    for (size_t i = 0; i < count; i++) {
+        watch_line_(buses_[i], now);
+    }
+}
+
+void DaliBusScheduler::watch_lines_(DaliBusComponent** buses, size_t count, uint32_t duration_us) {
+    int64_t begin = esp_timer_get_time();
+    int64_t now = begin;
+    do {
+        for (size_t i = 0; i < count; i++) {
+            watch_line_(buses[i], now);
+        }
+        now = esp_timer_get_time();
+    } while (now - begin < duration_us);
+}
+
+void DaliBusScheduler::wait_idle_(DaliBusComponent** buses, size_t count, uint32_t idle_us, bool* idle) {
+    size_t remaining = count;
+    for (size_t i = 0; i < count; i++) {
+        idle[i] = false;
+    }
+
+    int64_t begin = esp_timer_get_time();
+    while (remaining > 0) {
+        int64_t now = esp_timer_get_time();
+        for (size_t i = 0; i < count; i++) {
+            if (idle[i]) {
+                continue;
+            }
+            watch_line_(buses[i], now);
+            if (now - buses[i]->m_idleSince >= idle_us) {
+                idle[i] = true;
+                remaining--;
+            }
+        }
+        if (now - begin > DALI_IDLE_TIMEOUT_US) {
+            // Line is busy for too long, give up on the remaining buses
+            return;
+        }
+
+        if (remaining == 0) {
+            return;
+        }
+
+        // Shortest remaining idle time of the lines still waited for
+        int64_t shortest = idle_us;
+        for (size_t i = 0; i < count; i++) {
+            if (!idle[i]) {
+                shortest = std::min<int64_t>(shortest, idle_us - (now - buses[i]->m_idleSince));
+            }
+        }
+        if (shortest > DALI_SLEEP_MIN_US) {
+            // Let the main loop run meanwhile. The lines are sampled again after every tick, and a
+            // frame another master started while we slept is caught by the collision check.
+            vTaskDelay(1);
+            busy_since_ = esp_timer_get_time();
+        } else {
+            yield_if_busy_();
+        }
+    }
+}
+
+void DaliBusScheduler::transmit_concurrent_(DaliBusComponent** buses, const uint32_t* frames, const uint8_t* lengths, bool* sent, size_t count,
+        int priority) {
+    // Buses still trying to send their frame, as indices into the arguments
+    size_t pending[DALI_MAX_BUSES];
+    size_t pending_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        sent[i] = false;
+        // A line without bus power never goes idle, fail at once instead of waiting for it
+        if (!buses[i]->m_busDown.load(std::memory_order_acquire)) {
+            pending[pending_count++] = i;
+        }
+    }
+
+    for (int attempt = 0; attempt <= DALI_COLLISION_RETRIES && pending_count > 0; attempt++) {
+        // Random settling time from the IEC 62386-101 window of the frame's priority.
+        // Retries back off into a lower priority window each time.
+        int window_priority = priority + attempt < 5 ? priority + attempt : 5;
+        const uint32_t* window = DALI_PRIORITY_SETTLING_US[window_priority - 1];
+        uint32_t idle_us = window[0] + random_uint32() % (window[1] - window[0] + 1);
+
+        DaliBusComponent* tx_buses[DALI_MAX_BUSES];
+        uint32_t tx_frames[DALI_MAX_BUSES];
+        uint8_t tx_lengths[DALI_MAX_BUSES];
+        size_t tx_index[DALI_MAX_BUSES];
+        bool idle[DALI_MAX_BUSES];
+        for (size_t p = 0; p < pending_count; p++) {
+            tx_buses[p] = buses[pending[p]];
+        }
+        wait_idle_(tx_buses, pending_count, idle_us, idle);
+
+        size_t tx_count = 0;
+        for (size_t p = 0; p < pending_count; p++) {
+            size_t i = pending[p];
+            if (!idle[p]) {
+                // Never found a gap, drop the frame
+                buses[i]->m_lostFrames.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            tx_buses[tx_count] = buses[i];
+            tx_frames[tx_count] = frames[i];
+            tx_lengths[tx_count] = lengths[i];
+            tx_index[tx_count] = i;
+            tx_count++;
+        }
+
+        bool collided[DALI_MAX_BUSES];
+        transmit_frame_(tx_buses, tx_frames, tx_lengths, collided, tx_count);
+
+        pending_count = 0;
+        for (size_t t = 0; t < tx_count; t++) {
+            if (!collided[t]) {
+                sent[tx_index[t]] = true;
+                continue;
+            }
+            tx_buses[t]->m_collisions.fetch_add(1, std::memory_order_relaxed);
+            if (attempt == DALI_COLLISION_RETRIES) {
+                tx_buses[t]->m_lostFrames.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                pending[pending_count++] = tx_index[t];
+            }
+        }
+    }
+}
+
+void DaliBusScheduler::transmit_frame_(DaliBusComponent** buses, const uint32_t* frames, const uint8_t* lengths, bool* collided, size_t count) {
+    // START bit followed by 16 or 24 data bits, MSB first
+    uint32_t bits[DALI_MAX_BUSES];
+    bool driven[DALI_MAX_BUSES];
+    int64_t break_end[DALI_MAX_BUSES];
+    // Delay until RX follows the START bit going active and idle again, -1 until seen
+    int64_t written[DALI_MAX_BUSES];
+    int32_t loopback[2][DALI_MAX_BUSES];
+    int longest = 0;
+    for (size_t i = 0; i < count; i++) {
+        bits[i] = (1ul << lengths[i]) | frames[i];
+        if (lengths[i] > longest) {
+            longest = lengths[i];
+        }
+        collided[i] = false;
+        break_end[i] = 0;
+        loopback[0][i] = -1;
+        loopback[1][i] = -1;
+        pause_monitor_(buses[i]);
+    }
+
+    // Interrupts are only masked around each edge and read-back, a late ISR in between
+    // does not move anything since every deadline is measured from the start of the frame
+    int64_t start = esp_timer_get_time() + LOCK_WINDOW_US;
+    int half = 0;
+    for (int step = 0; step <= longest; step++) {
+        for (int phase = 0; phase < 2; phase++) {
+            int64_t half_start = start + HALF_BIT_DEADLINE_US(half);
+            half++;
+            int64_t due = start + HALF_BIT_DEADLINE_US(half);
+            int64_t mid = (half_start + due) / 2;
+
+            approach_(half_start);
+            {
+                // This is timing critical
+                InterruptLock lock;
+                while (esp_timer_get_time() < half_start) { }
+                // NOTE: output is inverted - HIGH will pull the bus to 0V (logic low).
+                // A '1' is low then high on the bus, so TX is HIGH then LOW.
+                for (size_t i = 0; i < count; i++) {
+                    if (collided[i]) {
+                        continue;
+                    }
+                    // A shorter frame has ended, leave its line idle
+                    driven[i] = step <= lengths[i] && (((bits[i] >> (lengths[i] - step)) & 1) ^ phase);
+                    buses[i]->m_txPin->digital_write(driven[i]);
+                    if (step == 0) {
+                        written[i] = esp_timer_get_time();
+                    }
+                }
+            }
+
+            if (step == 0) {
+                // Only a measurement, an interrupt here makes it a few microseconds longer at worst
+                int64_t now;
+                while ((now = esp_timer_get_time()) < mid - LOCK_WINDOW_US) {
+                    for (size_t i = 0; i < count; i++) {
+                        if (loopback[phase][i] < 0 && buses[i]->m_rxPin->digital_read() == driven[i]) {
+                            loopback[phase][i] = (int32_t)(now - written[i]);
+                        }
+                    }
+                }
+            }
+
+            // Read back in the middle of the half-bit. If the line is active while
+            // we release it, another master is transmitting.
+            approach_(mid);
+            {
+                InterruptLock lock;
+                int64_t now;
+                while ((now = esp_timer_get_time()) < mid) { }
+
+                for (size_t i = 0; i < count; i++) {
+                    if (collided[i]) {
+                        if (break_end[i] != 0 && now >= break_end[i]) {
+                            buses[i]->m_txPin->digital_write(false);
+                            break_end[i] = 0;
+                        }
+                    } else if (step <= lengths[i] && !driven[i] && buses[i]->m_rxPin->digital_read()) {
+                        // Stop and hold the line active, so the other master notices as well
+                        collided[i] = true;
+                        buses[i]->m_txPin->digital_write(true);
+                        break_end[i] = now + DALI_BREAK_US;
+                    }
+                }
+            }
+        }
+    }
+
+    int64_t end = start + HALF_BIT_DEADLINE_US(half);
+    approach_(end);
+    {
+        InterruptLock lock;
+        while (esp_timer_get_time() < end) { }
+        for (size_t i = 0; i < count; i++) {
+            if (!collided[i]) {
+                buses[i]->m_txPin->digital_write(false);
+            }
+        }
+    }
+
+    // Finish breaks still in progress
+    for (size_t i = 0; i < count; i++) {
+        if (break_end[i] != 0) {
+            while (esp_timer_get_time() < break_end[i]) { }
+            buses[i]->m_txPin->digital_write(false);
+        }
+    }
+
+    // Non critical, stop bits and settling time shared by all lines.
+    // The lines are watched meanwhile, so the next frame does not have to wait for an idle gap again.
+    watch_lines_(buses, count, HALF_BIT_PERIOD*2 + BIT_PERIOD*4);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!collided[i] && loopback[0][i] >= 0 && loopback[1][i] >= 0) {
+            buses[i]->m_loopback.store(((uint32_t)loopback[0][i] << 16) | (uint32_t)loopback[1][i], std::memory_order_relaxed);
+        }
+        record_frame_(buses[i], DaliFrameRecord { start, frames[i], lengths[i], DaliFrameSource::TX, collided[i] });
+        resume_monitor_(buses[i]);
+    }
+}
+
+void DaliBusScheduler::receive_concurrent_(DaliBusComponent** buses, const uint8_t* timeouts_ms, uint8_t* replies, bool* received, size_t count) {
+    int64_t started[DALI_MAX_BUSES]; // 0 while waiting for the START bit
+    int32_t offset[DALI_MAX_BUSES];
+    uint8_t sampled[DALI_MAX_BUSES];
+    bool done[DALI_MAX_BUSES];
+    size_t remaining = count;
+    bool any_reply = false;
+
+    for (size_t i = 0; i < count; i++) {
+        started[i] = 0;
+        offset[i] = sample_offset_us(buses[i]);
+        sampled[i] = 0;
+        done[i] = false;
+        replies[i] = 0;
+        pause_monitor_(buses[i]);
+        // A line held active would read as a reply of all ones
+        if (buses[i]->m_busDown.load(std::memory_order_acquire)) {
+            done[i] = true;
+            remaining--;
+        }
+    }
+
+    int64_t begin = esp_timer_get_time();
+    while (remaining > 0) {
+        int64_t now = esp_timer_get_time();
+
+        size_t next = count;
+        int64_t next_due = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (done[i]) {
+                continue;
+            }
+
+            if (started[i] == 0) {
+                // Wait for START bit
+                if (buses[i]->m_rxPin->digital_read()) {
+                    started[i] = now;
+                } else if (now - begin >= std::min<int64_t>((int64_t)timeouts_ms[i] * 1000, DALI_REPLY_WINDOW_US)) {
+                    // No reply (NACK), and past the backward frame settling time none will come
+                    done[i] = true;
+                    remaining--;
+                }
+                continue;
+            }
+
+            int64_t due = started[i] + offset[i] + (int64_t)sampled[i] * BIT_PERIOD;
+            if (next == count || due < next_due) {
+                next = i;
+                next_due = due;
+            }
+        }
+
+        if (next == count || next_due - now > LOCK_WINDOW_US) {
+            continue;
+        }
+
+        {
+            // This is timing critical
+            InterruptLock lock;
+            while (esp_timer_get_time() < next_due) { }
+            replies[next] = (replies[next] << 1) | (buses[next]->m_rxPin->digital_read() ? 1 : 0);
+        }
+
+        if (++sampled[next] == 8) {
+            done[next] = true;
+            remaining--;
+            any_reply = true;
+        }
+    }
+
+    if (any_reply) {
+        // Stop bits, then minimum time before we can send another forward frame
+        watch_lines_(buses, count, BIT_PERIOD*2 + BIT_PERIOD*8);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        received[i] = sampled[i] == 8;
+        record_frame_(buses[i], DaliFrameRecord { received[i] ? started[i] : begin, replies[i], (uint8_t)(received[i] ? 8 : 0), DaliFrameSource::RX, false });
+        resume_monitor_(buses[i]);
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <esphome.h>
+#include <atomic>
+#include <functional>
+#include "dali.h"
+#include "dali_ring.h"
+#include "dali_monitor.h"
+
+namespace esphome {
+namespace dali {
+
+class DaliBusComponent;
+
+#define QUARTER_BIT_PERIOD 208
+#define HALF_BIT_PERIOD 416
+#define BIT_PERIOD 833
+
+/// @brief Capacity of the per-bus command ring (main loop -> bus task)
+#define DALI_COMMAND_RING (64)
+/// @brief Capacity of the per-bus completion ring (bus task -> main loop)
+#define DALI_COMPLETION_RING (32)
+
+/// @brief Capacity of the per-bus monitor rings, only allocated when monitoring or listening for input events.
+/// A 24 bit frame has up to 50 edges.
+#define DALI_MONITOR_EDGE_RING (128)
+#define DALI_MONITOR_FRAME_RING (64)
+/// @brief How often the bus task checks for the end of a frame while one is on the wire
+#define DALI_MONITOR_POLL_TICKS (pdMS_TO_TICKS(2))
+
+/// @brief Multi-master collision handling. After a collision the line is held active for a
+/// break, then the frame is retried after a random settling time in a lower priority window.
+#define DALI_COLLISION_RETRIES (3)
+#define DALI_BREAK_US (1200)
+/// @brief IEC 62386-101 priority (1-5) of our forward frames, it selects their settling time window.
+/// Priority 1 is reserved for the second frame of a transaction, 2 is for user actions.
+#define DALI_FRAME_PRIORITY (2)
+#define DALI_REPEAT_PRIORITY (1)
+/// @brief Longest wait for an idle line before a frame is given up
+#define DALI_IDLE_TIMEOUT_US (100000)
+/// @brief Backward frames start at most 10.5 ms after the forward frame (IEC 62386-101 settling
+/// time), so a reply that has not started this long after listening began never comes
+#define DALI_REPLY_WINDOW_US (12000)
+/// @brief Waits longer than this sleep a tick at a time instead of spinning, the rest is spun
+#define DALI_SLEEP_MIN_US (2000 * portTICK_PERIOD_MS)
+
+/// @brief Bus power failure: a line held active for this long is shorted or has no bus power
+/// (IEC 62386-101 interface failure). It counts as back once it stayed idle for DALI_BUS_UP_US.
+#define DALI_BUS_DOWN_US (500000)
+#define DALI_BUS_UP_US (100000)
+/// @brief How often the bus task samples the lines while it has nothing else to do
+#define DALI_LINE_POLL_TICKS (pdMS_TO_TICKS(20))
+
+/// @brief Maximum number of DALI buses driven by one node
+#define DALI_MAX_BUSES (8)
+
+/// @brief Bus task configuration. Pinned to the last core, away from the WiFi stack on dual-core chips.
+/// It shares that core with the main loop, so it sleeps through settling times and only spins
+/// where bit timing needs it.
+#define DALI_TASK_CORE (portNUM_PROCESSORS - 1)
+#define DALI_TASK_PRIORITY (10)
+#define DALI_TASK_STACK_SIZE (4096)
+
+/// @brief Longest the bus task keeps the CPU before blocking for a tick, so lower priority tasks can run
+#define DALI_TASK_MAX_BUSY_US (50000)
+
+/// @brief Bit timing of one bus, measured with esp_timer on the bus task
+struct DaliBitTiming {
+    uint16_t half_bit_min_us = 0; ///< Shortest and longest half-bit of a dry run of the transmit loop, 0 until measured
+    uint16_t half_bit_max_us = 0;
+};
+
+/// @brief Work that needs exclusive, direct access to one bus (discovery, addressing, bus reset)
+struct DaliJob {
+    std::function<void()> run;  ///< Runs on the bus task
+    std::function<void()> done; ///< Runs on the main loop after run() returned
+};
+
+enum class DaliTransactionType : uint8_t {
+    FORWARD, ///< Send a forward frame, no reply expected
+    QUERY,   ///< Send a forward frame and receive the backward frame
+    RECEIVE, ///< Only receive a backward frame
+    JOB,     ///< Run a DaliJob
+};
+
+/// @brief Command ring entry
+struct DaliTransaction {
+    DaliTransactionType type;
+    uint8_t address;
+    uint8_t data;
+    uint8_t timeout_ms;
+    uint32_t tag; ///< Echoed in the completion, 0 if no completion is wanted
+    DaliJob* job;
+    uint8_t opcode = 0;  ///< Third byte of a 24 bit frame
+    uint8_t length = 16; ///< Frame length in bits, 16 or 24
+    bool twice = false;  ///< FORWARD only, send the frame again right after the first one
+
+    uint32_t frame() const {
+        return length == 24
+            ? ((uint32_t)address << 16) | ((uint32_t)data << 8) | opcode
+            : ((uint32_t)address << 8) | data;
+    }
+};
+
+/// @brief Completion ring entry
+struct DaliCompletion {
+    uint32_t tag;
+    uint8_t reply; ///< Backward frame, 0 if none was received
+    DaliJob* job;
+    bool received = false; ///< A backward frame arrived, tells a reply of 0 apart from none
+};
+
+/// @brief Shared scheduler driving every DALI bus on this node from one pinned FreeRTOS task.
+/// @remark All bus I/O happens on this task. ESPHome components talk to it through a
+/// lock-free command ring and a completion ring per bus, so the main loop never
+/// busy-waits on bit timing.
+/// All lines run at the same 1200 baud bit clock, so frames queued on different
+/// buses are transmitted in lockstep: one timing loop toggles every TX pin per half-bit.
+class DaliBusScheduler {
+public:
+    static DaliBusScheduler& instance();
+
+    /// @brief Add a bus. The bus task is started with the first one.
+    void register_bus(DaliBusComponent* bus);
+    size_t bus_count() const { return bus_count_.load(std::memory_order_acquire); }
+
+    bool is_running() const { return task_ != nullptr; }
+    bool in_bus_task() const { return task_ != nullptr && xTaskGetCurrentTaskHandle() == task_; }
+
+    /// @brief Wake the bus task after pushing to a command ring
+    void notify();
+    /// @brief Wake the bus task from the RX edge interrupt
+    void notify_from_isr();
+
+    /// @brief Transmit one frame right now. Bus task only (or before it is started).
+    /// @param frame Frame bits, right aligned
+    /// @param length 16 or 24
+    /// @return false if the frame was lost to collisions or a busy line
+    bool transmit(DaliBusComponent* bus, uint32_t frame, uint8_t length = 16);
+    /// @brief Transmit a frame and its repeat for commands that must be sent twice
+    bool transmit_twice(DaliBusComponent* bus, uint32_t frame, uint8_t length = 16);
+    /// @brief Receive one backward frame right now. Bus task only (or before it is started).
+    /// @param received Set to whether a backward frame arrived, may be null
+    uint8_t receive(DaliBusComponent* bus, unsigned long timeout_ms, bool* received = nullptr);
+
+    /// @brief Measure the half-bits of a dry run of the transmit loop
+    /// with the line left idle. Bus task only, run as a job before the first frame.
+    void calibrate(DaliBusComponent* bus);
+    /// @brief Time from the start bit to the first reply sample, corrected for the RX loopback delays
+    static int32_t sample_offset_us(const DaliBusComponent* bus);
+
+private:
+    DaliBusScheduler() = default;
+
+    static void task_entry_(void* arg);
+    void run_();
+    bool run_jobs_();
+    bool run_frames_();
+    void yield_if_busy_();
+    void complete_(DaliBusComponent* bus, uint32_t tag, uint8_t reply, DaliJob* job, bool received = false);
+
+    /// @brief Decode monitored RX edges. Returns true while a frame is still on the wire.
+    bool run_monitor_();
+    /// @brief Ignore RX edges while this node is using the bus, its own frames are logged directly
+    void pause_monitor_(DaliBusComponent* bus);
+    void resume_monitor_(DaliBusComponent* bus);
+    void record_frame_(DaliBusComponent* bus, const DaliFrameRecord& frame);
+
+    /// @brief Transmit with idle line detection and collision retries
+    /// @param priority IEC 62386-101 priority whose settling time window precedes the frames
+    void transmit_concurrent_(DaliBusComponent** buses, const uint32_t* frames, const uint8_t* lengths, bool* sent, size_t count,
+        int priority = DALI_FRAME_PRIORITY);
+    /// @brief One transmission attempt, reading back every half-bit.
+    /// 16 and 24 bit frames can be mixed, shorter frames end early.
+    void transmit_frame_(DaliBusComponent** buses, const uint32_t* frames, const uint8_t* lengths, bool* collided, size_t count);
+
+    /// @brief Sample a line, tracking since when it has been idle and whether it has lost bus power
+    void watch_line_(DaliBusComponent* bus, int64_t now);
+    /// @brief Sample every line once, so bus power failures are noticed while nothing is queued
+    void check_lines_();
+    void watch_lines_(DaliBusComponent** buses, size_t count, uint32_t duration_us);
+    /// @brief Wait until each line has been idle for idle_us, idle[i] is false for lines that never were
+    void wait_idle_(DaliBusComponent** buses, size_t count, uint32_t idle_us, bool* idle);
+    void receive_concurrent_(DaliBusComponent** buses, const uint8_t* timeouts_ms, uint8_t* replies, bool* received, size_t count);
+
+    DaliBusComponent* buses_[DALI_MAX_BUSES];
+    std::atomic<size_t> bus_count_ { 0 };
+    TaskHandle_t task_ = nullptr;
+    int64_t busy_since_ = 0;
+};
+
+}  // namespace dali
+}  // namespace esphome
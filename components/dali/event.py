@@ -0,0 +1,42 @@
+from esphome.components import event
+from esphome.const import CONF_ADDRESS
+
+import esphome.codegen as cg
+import esphome.config_validation as cv
+
+from . import dali_ns, CONF_DALI_BUS, DaliBusComponent
+
+DEPENDENCIES = ['dali']
+
+CONF_INSTANCE = 'instance'
+
+DaliInputEvent = dali_ns.class_('DaliInputEvent', event.Event, cg.Component)
+
+# IEC 62386-301 push button events
+BUTTON_EVENT_TYPES = [
+    "pressed",
+    "released",
+    "short_press",
+    "double_press",
+    "long_press_start",
+    "long_press_repeat",
+    "long_press_stop",
+    "free",
+    "stuck",
+]
+
+CONFIG_SCHEMA = event.event_schema(DaliInputEvent).extend({
+    cv.GenerateID(CONF_DALI_BUS): cv.use_id(DaliBusComponent),
+    cv.Required(CONF_ADDRESS): cv.int_range(0, 63), # Input device short address
+    cv.Optional(CONF_INSTANCE, default=0): cv.int_range(0, 31),
+}).extend(cv.COMPONENT_SCHEMA)
+
+async def to_code(config):
+    parent = await cg.get_variable(config[CONF_DALI_BUS])
+
+    var = await event.new_event(config, parent, event_types=BUTTON_EVENT_TYPES)
+    await cg.register_component(var, config)
+
+    cg.add(var.set_address(config[CONF_ADDRESS]))
+    cg.add(var.set_instance(config[CONF_INSTANCE]))
+    cg.add(parent.set_input_events(True))
@@ -1,7 +1,24 @@
-from esphome.components import light, output
+from esphome import automation
+from esphome.components import light, output, sensor
+from esphome.components.light.effects import (
+    MONOCHROMATIC_EFFECTS,
+    register_monochromatic_effect,
+    validate_effects,
+)
 from esphome.const import (
     CONF_ID, 
+    CONF_NAME,
+    CONF_DURATION,
+    CONF_EFFECTS,
     CONF_OUTPUT_ID, 
+    CONF_POWER,
+    CONF_ENERGY,
+    DEVICE_CLASS_POWER,
+    DEVICE_CLASS_ENERGY,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_WATT,
+    UNIT_WATT_HOURS,
     CONF_ADDRESS, 
     CONF_BRIGHTNESS, 
     CONF_COLOR_TEMPERATURE,
@@ -13,6 +30,8 @@ from esphome.const import (
 
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
+from esphome.core import CORE, EsphomeError, coroutine_with_priority
 import math
 
 from . import dali_ns, dali_lib_ns, CONF_DALI_BUS, DaliBusComponent
@@ -20,9 +39,40 @@ from . import dali_ns, dali_lib_ns, CONF_DALI_BUS, DaliBusComponent
 CONF_FADE_TIME = 'fade_time'
 CONF_FADE_RATE = 'fade_rate'
 CONF_BRIGHTNESS_CURVE = 'brightness_curve'
+CONF_MIN_LEVEL = 'min_level'
+CONF_MAX_LEVEL = 'max_level'
+CONF_POWER_ON_LEVEL = 'power_on_level'
+CONF_VERIFY = 'verify'
+CONF_NOMINAL_POWER = 'nominal_power'
+CONF_GROUPS = 'groups'
+CONF_DIRECTION = 'direction'
+CONF_MODE = 'mode'
 DEPENDENCIES = ['dali']
+AUTO_LOAD = ['sensor']
 
 DaliLight = dali_ns.class_('DaliLight', light.LightOutput)
+DaliDeviceConfig = dali_ns.struct('DaliDeviceConfig')
+DaliPulseEffect = dali_ns.class_('DaliPulseEffect', light.LightEffect)
+DaliBreatheEffect = dali_ns.class_('DaliBreatheEffect', light.LightEffect)
+DaliWakeUpEffect = dali_ns.class_('DaliWakeUpEffect', light.LightEffect)
+DaliIdentifyEffect = dali_ns.class_('DaliIdentifyEffect', light.LightEffect)
+DaliStartDimAction = dali_ns.class_('DaliStartDimAction', automation.Action)
+DaliStopDimAction = dali_ns.class_('DaliStopDimAction', automation.Action)
+
+# Lights per bus, collected for the device tables
+DATA_DEVICE_TABLES = 'dali_device_tables'
+
+ADDR_BROADCAST = 0x7F
+
+# DaliDeviceConfig::flags
+DALI_CONFIG_FADE_TIME = 0x01
+DALI_CONFIG_FADE_RATE = 0x02
+DALI_CONFIG_MIN_LEVEL = 0x04
+DALI_CONFIG_MAX_LEVEL = 0x08
+DALI_CONFIG_POWER_ON_LEVEL = 0x10
+DALI_CONFIG_BRIGHTNESS_CURVE = 0x20
+DALI_CONFIG_GROUPS = 0x40
+DALI_CONFIG_VERIFY = 0x80
 
 DaliColorMode = dali_ns.enum("DaliColorMode", is_class=True)
 DALI_COLOR_MODES = {
@@ -99,25 +149,172 @@ def validate_fade_rate(value):
     raise cv.Invalid(f"Fade rate must be one of {ALLOWABLE_FADE_RATES}")
 
 
-CONFIG_SCHEMA = light.LIGHT_SCHEMA.extend({
+def validate_levels(config):
+    if CONF_MIN_LEVEL in config and CONF_MAX_LEVEL in config:
+        if config[CONF_MIN_LEVEL] >= config[CONF_MAX_LEVEL]:
+            raise cv.Invalid(f"{CONF_MIN_LEVEL} must be less than {CONF_MAX_LEVEL}")
+    return config
+
+
+# Effects animated by the gear, ESPHome only sends a frame per phase.
+# Only for dali lights, they drive the DaliLight output directly.
+DALI_EFFECTS = ('dali_pulse', 'dali_breathe', 'dali_wake_up', 'dali_identify')
+
+@register_monochromatic_effect('dali_pulse', DaliPulseEffect, "DALI Pulse", {
+    cv.Optional(CONF_FADE_TIME, default='707ms'): validate_fade_time,
+})
+async def dali_pulse_effect_to_code(config, effect_id):
+    var = cg.new_Pvariable(effect_id, config[CONF_NAME])
+    cg.add(var.set_fade_time(config[CONF_FADE_TIME]))
+    return var
+
+
+@register_monochromatic_effect('dali_breathe', DaliBreatheEffect, "DALI Breathe", {
+    cv.Optional(CONF_FADE_RATE, default=7): validate_fade_rate,
+})
+async def dali_breathe_effect_to_code(config, effect_id):
+    var = cg.new_Pvariable(effect_id, config[CONF_NAME])
+    cg.add(var.set_fade_rate(config[CONF_FADE_RATE]))
+    return var
+
+
+@register_monochromatic_effect('dali_wake_up', DaliWakeUpEffect, "DALI Wake-up", {
+    cv.Optional(CONF_DURATION, default='5min'): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_BRIGHTNESS, default=1.0): cv.percentage,
+})
+async def dali_wake_up_effect_to_code(config, effect_id):
+    var = cg.new_Pvariable(effect_id, config[CONF_NAME])
+    cg.add(var.set_duration(config[CONF_DURATION]))
+    cg.add(var.set_brightness(config[CONF_BRIGHTNESS]))
+    return var
+
+
+@register_monochromatic_effect('dali_identify', DaliIdentifyEffect, "DALI Identify", {})
+async def dali_identify_effect_to_code(config, effect_id):
+    return cg.new_Pvariable(effect_id, config[CONF_NAME])
+
+
+CONFIG_SCHEMA = cv.All(light.LIGHT_SCHEMA.extend({
     cv.GenerateID(CONF_OUTPUT_ID): cv.declare_id(DaliLight),
 
     cv.Optional(CONF_COLD_WHITE_COLOR_TEMPERATURE, default='10000K'): cv.color_temperature,
     cv.Optional(CONF_WARM_WHITE_COLOR_TEMPERATURE, default='2700K'): cv.color_temperature,
 
     cv.GenerateID(CONF_DALI_BUS): cv.use_id(DaliBusComponent),
-    cv.Optional(CONF_ADDRESS): cv.int_,
+    # Short address 0-63, group 0x40-0x4F or broadcast 0x7F
+    cv.Optional(CONF_ADDRESS): cv.Any(cv.int_range(0, 0x4F), cv.one_of(ADDR_BROADCAST)),
 
     cv.Optional(CONF_COLOR_MODE): cv.enum(DALI_COLOR_MODES),
+    cv.Optional(CONF_EFFECTS): validate_effects(MONOCHROMATIC_EFFECTS),
     cv.Optional(CONF_BRIGHTNESS_CURVE): cv.enum(DALI_BRIGHTNESS_CURVES),
 
     cv.Optional(CONF_FADE_TIME): validate_fade_time, # TimePeriod (ms, s, m)
     cv.Optional(CONF_FADE_RATE): validate_fade_rate, # Rate (steps/second)
 
+    # Device limits, only written when they differ from what the gear reports
+    cv.Optional(CONF_MIN_LEVEL): cv.int_range(1, 254),
+    cv.Optional(CONF_MAX_LEVEL): cv.int_range(1, 254),
+    cv.Optional(CONF_POWER_ON_LEVEL): cv.int_range(0, 255), # 255 = restore last level
+
+    # Read back the level after each write and resend it on mismatch
+    cv.Optional(CONF_VERIFY): cv.boolean,
+
+    # Group membership, only written when it differs from the gear
+    cv.Optional(CONF_GROUPS): cv.ensure_list(cv.int_range(0, 15)),
+
+    # Power at full output. Power and energy are estimated from the level unless the
+    # gear reports them itself (IEC 62386-252)
+    cv.Optional(CONF_NOMINAL_POWER): cv.positive_float,
+    cv.Optional(CONF_POWER): sensor.sensor_schema(
+        unit_of_measurement=UNIT_WATT,
+        accuracy_decimals=1,
+        device_class=DEVICE_CLASS_POWER,
+        state_class=STATE_CLASS_MEASUREMENT,
+    ),
+    cv.Optional(CONF_ENERGY): sensor.sensor_schema(
+        unit_of_measurement=UNIT_WATT_HOURS,
+        accuracy_decimals=1,
+        device_class=DEVICE_CLASS_ENERGY,
+        state_class=STATE_CLASS_TOTAL_INCREASING,
+    ),
+
     # cv.Optional(
     #     CONF_DEFAULT_TRANSITION_LENGTH, default="1s"
     # ): cv.positive_time_period_milliseconds,
-}).extend(cv.COMPONENT_SCHEMA)
+}).extend(cv.COMPONENT_SCHEMA), validate_levels)
+
+
+def final_validate_address(config):
+    address = config.get(CONF_ADDRESS, ADDR_BROADCAST)
+    lights = [
+        conf for conf in fv.full_config.get().get('light', [])
+        if conf.get('platform') == 'dali'
+        and conf.get(CONF_DALI_BUS) == config[CONF_DALI_BUS]
+        and conf.get(CONF_ADDRESS, ADDR_BROADCAST) == address
+    ]
+    if len(lights) > 1:
+        raise cv.Invalid(f"Address 0x{address:02x} is used by more than one light on this bus", path=[CONF_ADDRESS])
+    return config
+
+def final_validate_effects(config):
+    # The effects are registered for every monochromatic light, but they drive a DaliLight output
+    for conf in fv.full_config.get().get('light', []):
+        if conf.get('platform') == 'dali':
+            continue
+        for effect in conf.get(CONF_EFFECTS, []):
+            for key in effect:
+                if key in DALI_EFFECTS:
+                    raise cv.Invalid(f"Effect '{key}' only works on dali lights, not on the {conf.get('platform')} light '{conf[CONF_ID]}'")
+    return config
+
+FINAL_VALIDATE_SCHEMA = cv.All(final_validate_address, final_validate_effects)
+
+
+def device_config_row(config):
+    flags = 0
+    fields = {
+        CONF_FADE_TIME: DALI_CONFIG_FADE_TIME,
+        CONF_FADE_RATE: DALI_CONFIG_FADE_RATE,
+        CONF_MIN_LEVEL: DALI_CONFIG_MIN_LEVEL,
+        CONF_MAX_LEVEL: DALI_CONFIG_MAX_LEVEL,
+        CONF_POWER_ON_LEVEL: DALI_CONFIG_POWER_ON_LEVEL,
+        CONF_BRIGHTNESS_CURVE: DALI_CONFIG_BRIGHTNESS_CURVE,
+        CONF_GROUPS: DALI_CONFIG_GROUPS,
+    }
+    for key, flag in fields.items():
+        if key in config:
+            flags |= flag
+    if config.get(CONF_VERIFY, False):
+        flags |= DALI_CONFIG_VERIFY
+
+    groups = 0
+    for group in config.get(CONF_GROUPS, []):
+        groups |= 1 << group
+
+    curve = DALI_BRIGHTNESS_CURVES[config.get(CONF_BRIGHTNESS_CURVE, "LOGARITHMIC")]
+    return (
+        f"{{0x{config.get(CONF_ADDRESS, ADDR_BROADCAST):02x}, 0x{flags:02x}, "
+        f"{config.get(CONF_FADE_TIME, 0) & 0x0F}, {config.get(CONF_FADE_RATE, 0) & 0x0F}, "
+        f"{config.get(CONF_MIN_LEVEL, 0)}, {config.get(CONF_MAX_LEVEL, 0)}, {config.get(CONF_POWER_ON_LEVEL, 0)}, "
+        f"{curve}, 0x{groups:04x}}}"
+    )
+
+
+@coroutine_with_priority(-100.0)
+async def emit_device_tables():
+    # One constexpr table per bus, once every light has been seen
+    for bus_id, lights in CORE.data[DATA_DEVICE_TABLES].items():
+        bus = await cg.get_variable(bus_id)
+        table = f"{bus_id}_devices"
+        rows = ",\n    ".join(row for _, row in lights)
+        cg.add_global(cg.RawStatement(f"static constexpr {DaliDeviceConfig} {table}[] = {{\n    {rows}\n}};"))
+        cg.add_global(cg.RawStatement(
+            f'static_assert({dali_ns}::dali_device_table_unique({table}, {len(lights)}), "Duplicate DALI address on {bus_id}");'
+        ))
+        cg.add(bus.set_device_table(cg.RawExpression(table), len(lights)))
+        for index, (var, _) in enumerate(lights):
+            cg.add(var.set_config(cg.RawExpression(f"&{table}[{index}]")))
+
 
 async def to_code(config):
     # DaliLight must be linked to DaliBusComponent
@@ -126,8 +323,11 @@ async def to_code(config):
     # LightState must be linked to DaliLight (LightOutput)
     var = await light.new_light(config, parent)
 
-    if CONF_ADDRESS in config:
-        cg.add(var.set_address(config[CONF_ADDRESS]))
+    # Address and gear settings go to the device table of the bus
+    tables = CORE.data.setdefault(DATA_DEVICE_TABLES, {})
+    if not tables:
+        CORE.add_job(emit_device_tables)
+    tables.setdefault(config[CONF_DALI_BUS], []).append((var, device_config_row(config)))
 
     if CONF_COLD_WHITE_COLOR_TEMPERATURE in config:
         cg.add(var.set_cold_white_temperature(config[CONF_COLD_WHITE_COLOR_TEMPERATURE]))
@@ -136,10 +336,53 @@ async def to_code(config):
 
     if CONF_COLOR_MODE in config:
         cg.add(var.set_color_mode(config[CONF_COLOR_MODE]))
-    if CONF_BRIGHTNESS_CURVE in config:
-        cg.add(var.set_brightness_curve(config[CONF_BRIGHTNESS_CURVE]))
 
-    if CONF_FADE_TIME in config:
-        cg.add(var.set_fade_time(config[CONF_FADE_TIME]))
-    if CONF_FADE_RATE in config:
-        cg.add(var.set_fade_rate(config[CONF_FADE_RATE]))
+    if CONF_NOMINAL_POWER in config:
+        cg.add(var.set_nominal_power(config[CONF_NOMINAL_POWER]))
+    if CONF_POWER in config:
+        sens = await sensor.new_sensor(config[CONF_POWER])
+        cg.add(var.set_power_sensor(sens))
+    if CONF_ENERGY in config:
+        sens = await sensor.new_sensor(config[CONF_ENERGY])
+        cg.add(var.set_energy_sensor(sens))
+
+
+# Hold-to-dim: the gear fades on its own between start_dim and stop_dim.
+# id is the light, which must be a dali light. Codegen passes its DaliLight output.
+
+DIM_DIRECTIONS = {"UP": True, "DOWN": False}
+
+START_DIM_ACTION_SCHEMA = cv.Schema({
+    cv.Required(CONF_ID): cv.use_id(light.LightState),
+    cv.Required(CONF_DIRECTION): cv.templatable(cv.one_of(*DIM_DIRECTIONS, upper=True)),
+    # STEP repeats UP/DOWN for gear without CONTINUOUS_UP/DOWN (DALI-1)
+    cv.Optional(CONF_MODE, default='CONTINUOUS'): cv.one_of('CONTINUOUS', 'STEP', upper=True),
+})
+
+STOP_DIM_ACTION_SCHEMA = automation.maybe_simple_id({
+    cv.Required(CONF_ID): cv.use_id(light.LightState),
+})
+
+async def get_dali_light_output(light_id):
+    # The actions drive the DaliLight output, so the light must be a dali light
+    for conf in CORE.config.get('light', []):
+        if conf[CONF_ID].id != light_id.id:
+            continue
+        if conf.get('platform') != 'dali':
+            raise EsphomeError(f"Light '{light_id.id}' is a {conf.get('platform')} light, dim actions need a dali light")
+        return await cg.get_variable(conf[CONF_OUTPUT_ID])
+    raise EsphomeError(f"Light '{light_id.id}' not found")
+
+@automation.register_action('dali.start_dim', DaliStartDimAction, START_DIM_ACTION_SCHEMA)
+async def start_dim_to_code(config, action_id, template_arg, args):
+    output = await get_dali_light_output(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, output)
+    up = await cg.templatable(config[CONF_DIRECTION], args, bool, to_exp=DIM_DIRECTIONS)
+    cg.add(var.set_up(up))
+    cg.add(var.set_step(config[CONF_MODE] == 'STEP'))
+    return var
+
+@automation.register_action('dali.stop_dim', DaliStopDimAction, STOP_DIM_ACTION_SCHEMA)
+async def stop_dim_to_code(config, action_id, template_arg, args):
+    output = await get_dali_light_output(config[CONF_ID])
+    return cg.new_Pvariable(action_id, template_arg, output)